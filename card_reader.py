@@ -168,7 +168,7 @@ class CardReader(object):
 
     def Read(self):
 
-        pkt, _ = self.sock.recvfrom(1024)
+        pkt, _ = self.sock.recvfrom(65536)
         msg = [0] * len(pkt)
         for i, v in enumerate(pkt):
             try:
@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+#include <memory>
+
+#include "../src/apduarena.h"
+
+using namespace Applet;
+
+using TestArena = APDUArena<1024>;
+
+TEST(apduArenaTest, AllocateFree) {
+    std::unique_ptr<TestArena> arena(new TestArena());
+    size_t freespace = arena->FreeSpace();
+
+    bstr a = arena->Allocate(100);
+    ASSERT_TRUE(arena->Allocated(a));
+    EXPECT_EQ(a.length(), 0);
+    EXPECT_GE(a.max_length(), 100);
+    a.append((const uint8_t *)"\x01\x02\x03", 3);
+
+    bstr b = arena->Allocate(200);
+    ASSERT_TRUE(arena->Allocated(b));
+    EXPECT_GE(b.data(), a.data() + a.max_length());
+    EXPECT_LT(arena->FreeSpace(), freespace - 300);
+
+    arena->Free(a);
+    EXPECT_FALSE(arena->Allocated(a));
+    arena->Free(b);
+    EXPECT_EQ(arena->FreeSpace(), freespace);
+
+    // free blocks are merged
+    bstr c = arena->Allocate(freespace);
+    EXPECT_TRUE(arena->Allocated(c));
+    arena->Free(c);
+}
+
+TEST(apduArenaTest, OutOfMemory) {
+    std::unique_ptr<TestArena> arena(new TestArena());
+    EXPECT_FALSE(arena->Allocated(arena->Allocate(1024)));
+
+    bstr a = arena->Allocate(600);
+    ASSERT_TRUE(arena->Allocated(a));
+    EXPECT_FALSE(arena->Allocated(arena->Allocate(600)));
+    arena->Free(a);
+    EXPECT_TRUE(arena->Allocated(arena->Allocate(600)));
+}
+
+TEST(apduArenaTest, Resize) {
+    std::unique_ptr<TestArena> arena(new TestArena());
+    size_t freespace = arena->FreeSpace();
+
+    // grows in place
+    bstr a = TestArena::Empty();
+    ASSERT_TRUE(arena->Resize(a, 4));
+    a.append((const uint8_t *)"\x01\x02\x03\x04", 4);
+    const uint8_t *data = a.data();
+    ASSERT_TRUE(arena->Resize(a, 400));
+    EXPECT_EQ(a.data(), data);
+    EXPECT_EQ(a.length(), 4);
+    EXPECT_GE(a.max_length(), 400);
+
+    // moves if the next block is used
+    bstr b = arena->Allocate(16);
+    ASSERT_TRUE(arena->Resize(a, 500));
+    EXPECT_NE(a.data(), data);
+    EXPECT_TRUE(a == "\x01\x02\x03\x04"_bstr);
+
+    // no space - buffer is not changed
+    EXPECT_FALSE(arena->Resize(a, 1000));
+    EXPECT_TRUE(a == "\x01\x02\x03\x04"_bstr);
+
+    // shrink gives the space back
+    ASSERT_TRUE(arena->Resize(a, 2));
+    EXPECT_TRUE(a == "\x01\x02"_bstr);
+    EXPECT_LT(a.max_length(), 100);
+
+    arena->Free(a);
+    arena->Free(b);
+    EXPECT_EQ(arena->FreeSpace(), freespace);
+}
+
+TEST(apduArenaTest, Space) {
+    using ChannelArena = APDUArena<APDUArenaSpace(APDUMaxResponseLength)>;
+    std::unique_ptr<ChannelArena> arena(new ChannelArena());
+
+    // one full response, then one full command, never both
+    bstr a = arena->Allocate(APDUMaxResponseLength);
+    ASSERT_TRUE(arena->Allocated(a));
+    EXPECT_FALSE(arena->Allocated(arena->Allocate(1)));
+    arena->Free(a);
+
+    bstr b = arena->Allocate(APDUMaxDataLength);
+    ASSERT_TRUE(arena->Allocated(b));
+    EXPECT_TRUE(arena->Resize(b, APDUMaxResponseLength));
+    arena->Free(b);
+
+    EXPECT_EQ(APDUArenaSpace(1), 16);
+    EXPECT_EQ(APDUArenaSpace(8), 16);
+}
+
+TEST(apduArenaTest, MaxAllocation) {
+    std::unique_ptr<TestArena> arena(new TestArena());
+    size_t max = arena->MaxAllocation();
+    EXPECT_EQ(max, arena->FreeSpace());
+
+    bstr a = arena->Allocate(100);
+    bstr b = arena->Allocate(100);
+    arena->Free(a);
+    // the hole before b is shorter than the tail
+    EXPECT_LT(arena->MaxAllocation(), arena->FreeSpace());
+    bstr c = arena->Allocate(arena->MaxAllocation());
+    EXPECT_TRUE(arena->Allocated(c));
+    EXPECT_EQ(arena->MaxAllocation(), arena->FreeSpace());
+    arena->Free(b);
+    arena->Free(c);
+    EXPECT_EQ(arena->MaxAllocation(), max);
+}
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+
+#include "../pc/shmring.h"
+
+TEST(shmringTest, PushPop) {
+    std::unique_ptr<SHMRING> ring(new SHMRING());
+    size_t len = 0;
+    EXPECT_EQ(shmring_front(ring.get(), &len), nullptr);
+
+    EXPECT_EQ(shmring_push(ring.get(), (const uint8_t *)"\x00\xa4\x04\x00", 4), 0);
+    EXPECT_EQ(shmring_push(ring.get(), (const uint8_t *)"\x90\x00\x01", 3), 0);
+
+    uint8_t *frame = shmring_front(ring.get(), &len);
+    ASSERT_NE(frame, nullptr);
+    EXPECT_EQ(len, 4);
+    EXPECT_EQ(memcmp(frame, "\x00\xa4\x04\x00", 4), 0);
+    shmring_pop(ring.get(), len);
+
+    frame = shmring_front(ring.get(), &len);
+    ASSERT_NE(frame, nullptr);
+    EXPECT_EQ(len, 3);
+    EXPECT_EQ(memcmp(frame, "\x90\x00\x01", 3), 0);
+    shmring_pop(ring.get(), len);
+
+    EXPECT_EQ(shmring_front(ring.get(), &len), nullptr);
+    EXPECT_EQ(shmring_wait(ring.get(), 0), -1);
+}
+
+TEST(shmringTest, ReserveCommit) {
+    std::unique_ptr<SHMRING> ring(new SHMRING());
+    uint8_t *frame = shmring_reserve(ring.get(), SHMRING_MAX_FRAME);
+    ASSERT_NE(frame, nullptr);
+    memcpy(frame, "\x6a\x82", 2);
+    shmring_commit(ring.get(), frame, 2);
+
+    size_t len = 0;
+    EXPECT_EQ(shmring_front(ring.get(), &len), frame);
+    EXPECT_EQ(len, 2);
+    EXPECT_EQ(ring->tail.load(), shmring_align(2));
+
+    EXPECT_EQ(shmring_reserve(ring.get(), SHMRING_MAX_FRAME + 1), nullptr);
+}
+
+TEST(shmringTest, FullAndWrap) {
+    std::unique_ptr<SHMRING> ring(new SHMRING());
+    static uint8_t data[SHMRING_MAX_FRAME];
+    size_t len = 0;
+
+    // 3 frames fit, the 4th does not
+    for (int i = 0; i < 3; i++) {
+        data[0] = i;
+        EXPECT_EQ(shmring_push(ring.get(), data, SHMRING_MAX_FRAME), 0);
+    }
+    EXPECT_EQ(shmring_push(ring.get(), data, SHMRING_MAX_FRAME), -1);
+
+    // free 2 frames. next frame does not fit to the end and goes to the beginning
+    for (int i = 0; i < 2; i++) {
+        uint8_t *frame = shmring_front(ring.get(), &len);
+        ASSERT_NE(frame, nullptr);
+        EXPECT_EQ(frame[0], i);
+        shmring_pop(ring.get(), len);
+    }
+    data[0] = 3;
+    EXPECT_EQ(shmring_push(ring.get(), data, SHMRING_MAX_FRAME), 0);
+
+    for (int i = 2; i < 4; i++) {
+        uint8_t *frame = shmring_front(ring.get(), &len);
+        ASSERT_NE(frame, nullptr);
+        EXPECT_EQ(len, SHMRING_MAX_FRAME);
+        EXPECT_EQ(frame[0], i);
+        shmring_pop(ring.get(), len);
+    }
+    EXPECT_EQ(ring->head.load(), ring->tail.load());
+}
+
+TEST(shmringTest, PingPong) {
+    std::unique_ptr<SHMAPDU_AREA> area(new SHMAPDU_AREA());
+    const uint32_t count = 100000;
+
+    std::thread card([&area, count] {
+        for (uint32_t n = 0; n < count;) {
+            if (shmring_wait(&area->req, 5000))
+                return;
+            size_t len;
+            uint8_t *apdu;
+            while ((apdu = shmring_front(&area->req, &len)) != nullptr) {
+                uint8_t *res;
+                while ((res = shmring_reserve(&area->res, SHMRING_MAX_FRAME)) == nullptr)
+                    sched_yield();
+                memcpy(res, apdu, len);
+                shmring_commit(&area->res, res, len);
+                shmring_pop(&area->req, len);
+                n++;
+            }
+        }
+    });
+
+    uint32_t received = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        // no ASSERT here: the card thread has to be joined
+        if (shmring_push(&area->req, (uint8_t *)&i, sizeof(i)) || shmring_wait(&area->res, 5000))
+            break;
+
+        size_t len;
+        uint8_t *res;
+        while ((res = shmring_front(&area->res, &len)) != nullptr) {
+            uint32_t v = 0;
+            EXPECT_EQ(len, sizeof(v));
+            memcpy(&v, res, sizeof(v));
+            EXPECT_EQ(v, received++);
+            shmring_pop(&area->res, len);
+        }
+    }
+    EXPECT_EQ(received, count);
+    card.join();
+}
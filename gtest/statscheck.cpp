@@ -0,0 +1,27 @@
+#include <gtest/gtest.h>
+
+#include "../src/stats.h"
+
+TEST(statsTest, Bucket) {
+    EXPECT_EQ(Stats::Bucket(0), 0);
+    EXPECT_EQ(Stats::Bucket(1), 1);
+    EXPECT_EQ(Stats::Bucket(2), 2);
+    EXPECT_EQ(Stats::Bucket(3), 2);
+    EXPECT_EQ(Stats::Bucket(1024), 11);
+    EXPECT_EQ(Stats::Bucket(0xffffffff), Stats::BucketCount - 1);
+}
+
+TEST(statsTest, Histogram) {
+    static Stats::Histogram hist;
+    hist.Add(10, 0);
+    hist.Add(3000, 100);
+    hist.Add(5, 20);
+
+    EXPECT_EQ(hist.count, 3);
+    EXPECT_EQ(hist.total, 3015);
+    EXPECT_EQ(hist.max, 3000);
+    EXPECT_EQ(hist.bytes, 120);
+    EXPECT_EQ(hist.buckets[Stats::Bucket(10)], 1);
+    EXPECT_EQ(hist.buckets[Stats::Bucket(5)], 1);
+    EXPECT_EQ(hist.buckets[12], 1);
+}
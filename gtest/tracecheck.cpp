@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+
+#include "../src/trace.h"
+
+using TestRing = Trace::TraceRing<8>;
+
+static Trace::Record MakeRecord(uint32_t value) {
+    Trace::Record rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.event = Trace::APDUResult;
+    rec.value = value;
+    return rec;
+}
+
+TEST(traceTest, ReadWrite) {
+    std::unique_ptr<TestRing> ring(new TestRing());
+    Trace::Record rec;
+    uint32_t lost = 0;
+    EXPECT_FALSE(ring->Read(rec, lost));
+
+    for (uint32_t i = 0; i < 3; i++) {
+        Trace::Record w = MakeRecord(i);
+        ring->Write(w);
+    }
+    for (uint32_t i = 0; i < 3; i++) {
+        ASSERT_TRUE(ring->Read(rec, lost));
+        EXPECT_EQ(rec.value, i);
+        EXPECT_EQ(rec.seq, i);
+    }
+    EXPECT_FALSE(ring->Read(rec, lost));
+    EXPECT_EQ(lost, 0);
+}
+
+TEST(traceTest, Overwrite) {
+    std::unique_ptr<TestRing> ring(new TestRing());
+    for (uint32_t i = 0; i < 20; i++) {
+        Trace::Record w = MakeRecord(i);
+        ring->Write(w);
+    }
+
+    // the oldest records are lost, the last 8 are in the ring
+    Trace::Record rec;
+    uint32_t lost = 0;
+    ASSERT_TRUE(ring->Read(rec, lost));
+    EXPECT_EQ(lost, 12);
+    EXPECT_EQ(rec.value, 12);
+    uint32_t count = 1;
+    while (ring->Read(rec, lost))
+        count++;
+    EXPECT_EQ(count, 8);
+    EXPECT_EQ(rec.value, 19);
+}
+
+TEST(traceTest, Producers) {
+    std::unique_ptr<Trace::TraceRing<1024>> ring(new Trace::TraceRing<1024>());
+    auto producer = [&](uint32_t base) {
+        for (uint32_t i = 0; i < 256; i++) {
+            Trace::Record w = MakeRecord(base + i);
+            ring->Write(w);
+        }
+    };
+    std::thread t1(producer, 0), t2(producer, 1000);
+    t1.join();
+    t2.join();
+
+    Trace::Record rec;
+    uint32_t lost = 0, count = 0, last1 = 0, last2 = 1000;
+    while (ring->Read(rec, lost)) {
+        // each producer keeps its order
+        uint32_t &last = (rec.value < 1000) ? last1 : last2;
+        EXPECT_GE(rec.value, last);
+        last = rec.value;
+        count++;
+    }
+    EXPECT_EQ(count, 512);
+    EXPECT_EQ(lost, 0);
+}
+
+TEST(traceTest, Format) {
+    Trace::Record rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.time = 1500002;
+    rec.event = Trace::APDUIn;
+    rec.value = 1;
+    rec.length = 20;
+    rec.datalen = 2;
+    rec.data[0] = 0x00;
+    rec.data[1] = 0xa4;
+
+    char line[256];
+    Trace::Format(rec, line, sizeof(line));
+    EXPECT_STREQ(line, "1.500002 apdu in: card 1 [20] 00 a4 ...");
+
+    // short buffer is cut
+    char small[8];
+    Trace::Format(rec, small, sizeof(small));
+    EXPECT_STREQ(small, "1.50000");
+}
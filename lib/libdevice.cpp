@@ -0,0 +1,46 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+// device.h of the library: there is no common device storage, each card
+// sets its own one in solopgp_create. see lib/solopgp.cpp
+
+#include "device.h"
+
+int hwinit() {
+    return 0;
+}
+
+int hwreboot() {
+    return 0;
+}
+
+uint8_t *hwflash(size_t *size) {
+    *size = 0;
+    return nullptr;
+}
+
+bool fileexist(char* name) {
+    return false;
+}
+
+int readfile(char* name, uint8_t * buf, size_t max_size, size_t *size) {
+    return 1;
+}
+
+int writefile(char* name, uint8_t * buf, size_t size) {
+    return 1;
+}
+
+int deletefile(char* name) {
+    return 1;
+}
+
+int deletefiles(char* name) {
+    return 1;
+}
@@ -0,0 +1,219 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <new>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "solopgp.h"
+#include "solofactory.h"
+
+/* Snapshot of the memory storage, little endian:
+   magic(4) version(4) file count(4), then for each file: name length(1) name data length(4) data */
+#define SOLOPGP_SNAPSHOT_MAGIC      0x53475053U     // "SPGS"
+#define SOLOPGP_SNAPSHOT_VERSION    1
+
+// files in the memory of the card
+class MemoryStorage : public File::Storage {
+public:
+    std::map<std::string, std::vector<uint8_t>> files;
+
+    bool FileExist(char *name) override {
+        return files.count(name) != 0;
+    }
+    int ReadFile(char *name, uint8_t *buf, size_t max_size, size_t *size) override {
+        auto it = files.find(name);
+        if (it == files.end() || it->second.size() > max_size)
+            return 1;
+        memcpy(buf, it->second.data(), it->second.size());
+        *size = it->second.size();
+        return 0;
+    }
+    int WriteFile(char *name, uint8_t *buf, size_t size) override {
+        files[name].assign(buf, buf + size);
+        return 0;
+    }
+    int DeleteFile(char *name) override {
+        files.erase(name);
+        return 0;
+    }
+    int DeleteFiles(char *name) override {
+        for (auto it = files.begin(); it != files.end();) {
+            if (fnmatch(name, it->first.c_str(), 0) == 0)
+                it = files.erase(it);
+            else
+                ++it;
+        }
+        return 0;
+    }
+};
+
+// files of the caller
+class CallbackStorage : public File::Storage {
+public:
+    solopgp_storage cb;
+
+    bool FileExist(char *name) override {
+        size_t len = 0;
+        return cb.read(cb.ctx, name, nullptr, 0, &len) == 0;
+    }
+    int ReadFile(char *name, uint8_t *buf, size_t max_size, size_t *size) override {
+        return cb.read(cb.ctx, name, buf, max_size, size);
+    }
+    int WriteFile(char *name, uint8_t *buf, size_t size) override {
+        return cb.write(cb.ctx, name, buf, size);
+    }
+    int DeleteFile(char *name) override {
+        return cb.remove(cb.ctx, name);
+    }
+    int DeleteFiles(char *name) override {
+        return cb.remove(cb.ctx, name);
+    }
+};
+
+// no default card: every call of the card core runs under SoloFactoryScope of its solopgp_card
+Factory::SoloFactory &Factory::SoloFactory::GetDefaultFactory() {
+    assert(!"libsolopgp: card core called outside of a solopgp_card");
+    abort();
+}
+
+struct solopgp_card {
+    Factory::SoloFactory factory;
+    MemoryStorage memory;
+    CallbackStorage callback;
+    bool external;
+};
+
+static void put_le32(std::vector<uint8_t> &buf, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        buf.push_back(value >> (8 * i));
+}
+
+static bool get_le32(const uint8_t **p, const uint8_t *end, uint32_t *value) {
+    if (end - *p < 4)
+        return false;
+    *value = (*p)[0] | ((*p)[1] << 8) | ((*p)[2] << 16) | ((uint32_t)(*p)[3] << 24);
+    *p += 4;
+    return true;
+}
+
+static bool restore_snapshot(MemoryStorage &memory, const uint8_t *snapshot, size_t len) {
+    const uint8_t *p = snapshot;
+    const uint8_t *end = snapshot + len;
+    uint32_t magic, version, count;
+    if (!get_le32(&p, end, &magic) || !get_le32(&p, end, &version) || !get_le32(&p, end, &count))
+        return false;
+    if (magic != SOLOPGP_SNAPSHOT_MAGIC || version != SOLOPGP_SNAPSHOT_VERSION)
+        return false;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (p >= end || end - p < 1 + *p)
+            return false;
+        std::string name((const char *)p + 1, *p);
+        p += 1 + *p;
+
+        uint32_t datalen;
+        if (!get_le32(&p, end, &datalen) || (size_t)(end - p) < datalen)
+            return false;
+        memory.files[name].assign(p, p + datalen);
+        p += datalen;
+    }
+    return p == end;
+}
+
+solopgp_card *solopgp_create(const solopgp_storage *storage, const uint8_t *snapshot, size_t snapshotlen) {
+    if (storage && (!storage->read || !storage->write || !storage->remove || snapshot))
+        return nullptr;
+
+    solopgp_card *card = new (std::nothrow) solopgp_card();
+    if (card == nullptr)
+        return nullptr;
+
+    card->external = storage != nullptr;
+    if (storage)
+        card->callback.cb = *storage;
+    if (snapshot && !restore_snapshot(card->memory, snapshot, snapshotlen)) {
+        delete card;
+        return nullptr;
+    }
+
+    Factory::SoloFactory &factory = card->factory;
+    if (card->external)
+        factory.GetFileSystem().SetStorage(&card->callback);
+    else
+        factory.GetFileSystem().SetStorage(&card->memory);
+    factory.Init();
+
+    return card;
+}
+
+int solopgp_execute(solopgp_card *card, const uint8_t *cmd, size_t cmdlen,
+        uint8_t *res, size_t resmax, size_t *reslen) {
+    if (card == nullptr || cmd == nullptr || res == nullptr || reslen == nullptr)
+        return SOLOPGP_ERR_ARGS;
+    *reslen = 0;
+    if (resmax < SOLOPGP_MIN_RESPONSE_LENGTH)
+        return SOLOPGP_ERR_BUFFER;
+
+    Factory::SoloFactoryScope scope(card->factory);
+
+    // the executor builds a short response in its own buffer and copies it
+    auto resstr = bstr(res, 0, resmax);
+    card->factory.GetAPDUExecutor().Execute(bstr(cmd, cmdlen), resstr, resmax);
+    *reslen = resstr.length();
+    return SOLOPGP_OK;
+}
+
+int solopgp_execute_batch(solopgp_card *card, solopgp_apdu *apdus, size_t count) {
+    if (apdus == nullptr && count)
+        return SOLOPGP_ERR_ARGS;
+
+    for (size_t i = 0; i < count; i++)
+        apdus[i].reslen = 0;
+    for (size_t i = 0; i < count; i++) {
+        solopgp_apdu &apdu = apdus[i];
+        int res = solopgp_execute(card, apdu.cmd, apdu.cmdlen, apdu.res, apdu.resmax, &apdu.reslen);
+        if (res != SOLOPGP_OK)
+            return res;
+    }
+    return SOLOPGP_OK;
+}
+
+int solopgp_snapshot(solopgp_card *card, uint8_t *buf, size_t maxlen, size_t *len) {
+    if (card == nullptr || len == nullptr)
+        return SOLOPGP_ERR_ARGS;
+    if (card->external)
+        return SOLOPGP_ERR_STORAGE;
+
+    std::vector<uint8_t> snapshot;
+    put_le32(snapshot, SOLOPGP_SNAPSHOT_MAGIC);
+    put_le32(snapshot, SOLOPGP_SNAPSHOT_VERSION);
+    put_le32(snapshot, card->memory.files.size());
+    for (auto &file : card->memory.files) {
+        snapshot.push_back(file.first.size());
+        snapshot.insert(snapshot.end(), file.first.begin(), file.first.end());
+        put_le32(snapshot, file.second.size());
+        snapshot.insert(snapshot.end(), file.second.begin(), file.second.end());
+    }
+
+    *len = snapshot.size();
+    if (buf == nullptr || maxlen < snapshot.size())
+        return SOLOPGP_ERR_BUFFER;
+    memcpy(buf, snapshot.data(), snapshot.size());
+    return SOLOPGP_OK;
+}
+
+void solopgp_destroy(solopgp_card *card) {
+    delete card;
+}
@@ -0,0 +1,89 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+
+#ifndef SOLOPGP_H_
+#define SOLOPGP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* libsolopgp: the card core without usbip, sockets and the data dir of ./main.
+   Each card has its own executor, security state and file storage, so cards may
+   run in parallel threads. One card must not be used by two threads at the same time.
+   Most of a card is the apdu arena (APDU_ARENA_SIZE, 320 KB in the Makefile build). The logical
+   channels share it for chained commands and GET RESPONSE data, a command gets 6A84 if it is full.
+   The trace (see src/trace.h) is common for the process, statistics (src/stats.h) are per card. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SOLOPGP_OK                  0
+#define SOLOPGP_ERR_ARGS            -1
+#define SOLOPGP_ERR_MEMORY          -2
+#define SOLOPGP_ERR_BUFFER          -3      // response or snapshot buffer is too small
+#define SOLOPGP_ERR_SNAPSHOT        -4      // broken snapshot
+#define SOLOPGP_ERR_STORAGE         -5      // snapshot of a card with the caller's storage
+
+// iso7816 extended length response with status word
+#define SOLOPGP_MAX_RESPONSE_LENGTH (0x10000 + 2)
+// short response with status word
+#define SOLOPGP_MIN_RESPONSE_LENGTH (0x100 + 2)
+
+typedef struct solopgp_card solopgp_card;
+
+/* Files of a card. Names are short ascii strings without '/'. 0 - ok.
+   read: buf == NULL - only check if the file exists.
+   remove: name is a fnmatch pattern, e.g. "2_*" for all the files of an applet. */
+typedef struct solopgp_storage
+{
+    void *ctx;
+    int (*read)(void *ctx, const char *name, uint8_t *buf, size_t maxlen, size_t *len);
+    int (*write)(void *ctx, const char *name, const uint8_t *buf, size_t len);
+    int (*remove)(void *ctx, const char *name);
+}solopgp_storage;
+
+typedef struct solopgp_apdu
+{
+    const uint8_t *cmd;
+    size_t cmdlen;
+    uint8_t *res;
+    size_t resmax;
+    size_t reslen;      // out
+}solopgp_apdu;
+
+/* storage == NULL - files are in the memory of the card. snapshot (may be NULL) is
+   a result of solopgp_snapshot of such a card and restores its files.
+   storage is copied, its ctx must live until solopgp_destroy. NULL on error. */
+extern solopgp_card *solopgp_create(const solopgp_storage *storage, const uint8_t *snapshot, size_t snapshotlen);
+
+/* one command apdu. res gets the response with status word, it must not overlap cmd.
+   with resmax SOLOPGP_MAX_RESPONSE_LENGTH or more the card builds the response in res,
+   with less it is built in a buffer of the card and copied. a response longer than resmax
+   is 61xx and waits for GET RESPONSE, as with a reader with short apdus.
+   SOLOPGP_ERR_BUFFER - resmax is less than SOLOPGP_MIN_RESPONSE_LENGTH. */
+extern int solopgp_execute(solopgp_card *card, const uint8_t *cmd, size_t cmdlen,
+        uint8_t *res, size_t resmax, size_t *reslen);
+
+/* apdus one after another. stops on the first error and returns it,
+   reslen of the apdus after it is 0. */
+extern int solopgp_execute_batch(solopgp_card *card, solopgp_apdu *apdus, size_t count);
+
+/* files of a card with memory storage. buf == NULL or too small -
+   SOLOPGP_ERR_BUFFER and len is the needed size. */
+extern int solopgp_snapshot(solopgp_card *card, uint8_t *buf, size_t maxlen, size_t *len);
+
+extern void solopgp_destroy(solopgp_card *card);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SOLOPGP_H_ */
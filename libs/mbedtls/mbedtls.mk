@@ -19,7 +19,7 @@ MBEDTLS_CONFIG= -DMBEDTLS_CONFIG_FILE=\"mbedtls_config.h\"
 MBEDTLS_OBJ = $(MBEDTLS_SRCS:.c=.o)
 
 $(MBEDTLS_DIR)%.o:  $(MBEDTLS_DIR)%.c
-	gcc  $^ -o $@ $(MBEDTLS_INCLUDE) $(MBEDTLS_CONFIG) -c -Os -fdata-sections -ffunction-sections
+	gcc  $^ -o $@ $(MBEDTLS_INCLUDE) $(MBEDTLS_CONFIG) -c -Os -fPIC -fdata-sections -ffunction-sections
 
 
 libs/mbedtls/mbedtls.a: $(MBEDTLS_DIR) $(MBEDTLS_OBJ)
@@ -13,7 +13,7 @@ SPIFFS_INCLUDE= -I. -Ilibs/spiffs -Ilibs/spiffs/spiffs/src/ -Ilibs/spiffs/
 SPIFFS_OBJ = $(SPIFFS_SRCS:.c=.o)
 
 $(SPIFFS_DIR)%.o:  $(SPIFFS_DIR)%.c
-	gcc  $^ -o $@ $(SPIFFS_INCLUDE) -c -Os -fdata-sections -ffunction-sections
+	gcc  $^ -o $@ $(SPIFFS_INCLUDE) -c -Os -fPIC -fdata-sections -ffunction-sections
 
 
 $(SPIFFS_DIR):
@@ -0,0 +1,101 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "apducapture.h"
+
+static FILE *capfile = nullptr;
+static uint64_t capstart = 0;
+
+uint64_t apducapture_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+int apducapture_open(const char *path, const uint8_t *image, size_t imagesize) {
+    // the flash image has the keys and the VERIFY commands have the PINs: owner only,
+    // also if the file was there before
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0 || fchmod(fd, 0600) != 0 || (capfile = fdopen(fd, "wb")) == nullptr) {
+        printf("capture: can't open %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+
+    APDUCAPTURE_HEADER hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = APDUCAPTURE_MAGIC;
+    hdr.version = APDUCAPTURE_VERSION;
+    hdr.imagesize = imagesize;
+    if (fwrite(&hdr, sizeof(hdr), 1, capfile) != 1 ||
+            (imagesize && fwrite(image, imagesize, 1, capfile) != 1)) {
+        printf("capture: write error %s\n", path);
+        fclose(capfile);
+        capfile = nullptr;
+        return 1;
+    }
+    fflush(capfile);
+
+    capstart = apducapture_now_us();
+    printf("capture: %s\n", path);
+    return 0;
+}
+
+bool apducapture_enabled() {
+    return capfile != nullptr;
+}
+
+void apducapture_write(uint8_t card, const uint8_t *cmd, size_t cmdlen,
+        const uint8_t *res, size_t reslen, uint64_t start_us, uint64_t stop_us) {
+    if (capfile == nullptr)
+        return;
+
+    APDUCAPTURE_RECORD rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.time = start_us - capstart;
+    rec.duration = stop_us - start_us;
+    rec.card = card;
+    rec.cmdlen = cmdlen;
+    rec.reslen = reslen;
+
+    // cards run in parallel threads, records must not interleave
+    flockfile(capfile);
+    fwrite(&rec, sizeof(rec), 1, capfile);
+    fwrite(cmd, 1, cmdlen, capfile);
+    fwrite(res, 1, reslen, capfile);
+    // the process is stopped by a signal, so the record must reach the file now
+    fflush(capfile);
+    funlockfile(capfile);
+}
+
+int apducapture_read_header(FILE *f, APDUCAPTURE_HEADER *hdr) {
+    if (fread(hdr, sizeof(*hdr), 1, f) != 1)
+        return 1;
+    if (hdr->magic != APDUCAPTURE_MAGIC || hdr->version != APDUCAPTURE_VERSION)
+        return 1;
+    return 0;
+}
+
+int apducapture_read(FILE *f, APDUCAPTURE_RECORD *rec, uint8_t *cmd, uint8_t *res, size_t maxlen) {
+    if (fread(rec, sizeof(*rec), 1, f) != 1)
+        return feof(f) ? 1 : -1;
+    if (rec->cmdlen > maxlen || rec->reslen > maxlen)
+        return -1;
+    if (fread(cmd, 1, rec->cmdlen, f) != rec->cmdlen ||
+            fread(res, 1, rec->reslen, f) != rec->reslen)
+        return -1;
+    return 0;
+}
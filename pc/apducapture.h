@@ -0,0 +1,58 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+
+#ifndef APDUCAPTURE_H_
+#define APDUCAPTURE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Capture of command/response pairs for tools/apdureplay.
+   File: header, flash image at the capture start (imagesize bytes), then records.
+   Record: APDUCAPTURE_RECORD + command (cmdlen) + response (reslen). Little endian. */
+#define APDUCAPTURE_MAGIC       0x54504153U     // "SAPT"
+#define APDUCAPTURE_VERSION     1
+
+typedef struct _APDUCAPTURE_HEADER
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t imagesize;
+    uint32_t reserved;
+}APDUCAPTURE_HEADER;
+
+typedef struct _APDUCAPTURE_RECORD
+{
+    uint64_t time;          // us from the capture start
+    uint32_t duration;      // us in APDUExecutor::Execute
+    uint8_t card;
+    uint8_t reserved[3];
+    uint32_t cmdlen;
+    uint32_t reslen;
+}APDUCAPTURE_RECORD;
+
+static_assert(sizeof(APDUCAPTURE_RECORD) == 24, "record size is a part of the file format");
+
+extern uint64_t apducapture_now_us();
+
+// writer. apducapture_open before the card threads start, apducapture_write
+// from any of them: a record is written under flockfile and does not interleave.
+extern int apducapture_open(const char *path, const uint8_t *image, size_t imagesize);
+extern bool apducapture_enabled();
+extern void apducapture_write(uint8_t card, const uint8_t *cmd, size_t cmdlen,
+        const uint8_t *res, size_t reslen, uint64_t start_us, uint64_t stop_us);
+
+// reader. image and buffers are malloc'ed by the caller.
+extern int apducapture_read_header(FILE *f, APDUCAPTURE_HEADER *hdr);
+// 0 - ok, 1 - end of file, -1 - error
+extern int apducapture_read(FILE *f, APDUCAPTURE_RECORD *rec, uint8_t *cmd, uint8_t *res, size_t maxlen);
+
+#endif /* APDUCAPTURE_H_ */
@@ -0,0 +1,189 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+
+#include "apdusock.h"
+
+#define APDUSOCK_MAX_EVENTS 16
+
+static_assert(APDUSOCK_MAX_DATA >= CCID_RESPONSE_BUFFER_SIZE, "responses are built in resbuf");
+
+static uint8_t resbuf[APDUSOCK_MAX_DATA];
+
+// request being received on one connection. reads are MSG_DONTWAIT, so a client that sent
+// a part of a frame does not stop the others. replies are sent blocking.
+typedef struct _APDUSOCK_CONN
+{
+    int fd;
+    uint8_t hdr[APDUSOCK_HEADER_SIZE];
+    size_t hdrlen;                  // received bytes of hdr
+    size_t datalen;                 // received bytes of data
+    uint8_t data[APDUSOCK_MAX_DATA];
+}APDUSOCK_CONN;
+
+// one request. returns -1 if the connection must be closed.
+static int apdusock_handle(APDUSOCK_CONN *conn, ex_cb cb) {
+    uint8_t type = conn->hdr[0];
+    size_t len = conn->datalen;
+    size_t reslen = 0;
+    
+    switch (type) {
+    case APDUSOCK_APDU:
+        cb(0, conn->data, len, resbuf, &reslen);
+        break;
+    case APDUSOCK_POWERON:
+        reslen = ccid_get_atr(resbuf, sizeof(resbuf));
+        break;
+    case APDUSOCK_POWEROFF:
+        break;
+    default:
+        printf("apdusock: unknown frame type 0x%02x\n", type);
+        type = APDUSOCK_ERROR;
+        break;
+    }
+    
+    return apdusock_send_frame(conn->fd, type, resbuf, reslen);
+}
+
+// reads what is there. returns -1 if the connection must be closed.
+static int apdusock_receive(APDUSOCK_CONN *conn, ex_cb cb) {
+    ssize_t res;
+    if (conn->hdrlen < APDUSOCK_HEADER_SIZE) {
+        res = recv(conn->fd, conn->hdr + conn->hdrlen, APDUSOCK_HEADER_SIZE - conn->hdrlen, MSG_DONTWAIT);
+    } else {
+        size_t len = apdusock_frame_length(conn->hdr);
+        res = recv(conn->fd, conn->data + conn->datalen, len - conn->datalen, MSG_DONTWAIT);
+    }
+    if (res < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    if (res == 0)
+        return -1;
+    
+    if (conn->hdrlen < APDUSOCK_HEADER_SIZE) {
+        conn->hdrlen += res;
+        if (conn->hdrlen < APDUSOCK_HEADER_SIZE)
+            return 0;
+        if (apdusock_frame_length(conn->hdr) > APDUSOCK_MAX_DATA)
+            return -1;
+    } else {
+        conn->datalen += res;
+    }
+    
+    if (conn->datalen < apdusock_frame_length(conn->hdr))
+        return 0;
+    
+    int err = apdusock_handle(conn, cb);
+    conn->hdrlen = 0;
+    conn->datalen = 0;
+    return err;
+}
+
+// another card process listens on the path
+static bool apdusock_in_use(const char *path) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return false;
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    bool res = connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    close(fd);
+    return res;
+}
+
+int apdusock_start(const char *path, ex_cb cb) {
+    struct sockaddr_un addr;
+    struct epoll_event ev, events[APDUSOCK_MAX_EVENTS];
+    int listenfd, epollfd, nfds, i;
+    
+    // only a stale socket of a finished process is removed
+    if (apdusock_in_use(path)) {
+        printf("apdusock: %s is used by another process. set --apdusock-path\n", path);
+        return 1;
+    }
+    
+    if ((listenfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        printf("apdusock socket error : %s \n", strerror(errno));
+        return 1;
+    }
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    
+    if (bind(listenfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        printf("apdusock bind error : %s \n", strerror(errno));
+        close(listenfd);
+        return 1;
+    }
+    
+    if (listen(listenfd, SOMAXCONN) < 0 || (epollfd = epoll_create1(0)) < 0) {
+        printf("apdusock listen error : %s \n", strerror(errno));
+        close(listenfd);
+        return 1;
+    }
+    
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, listenfd, &ev);
+    printf("apdusock listening on %s\n", path);
+    
+    while (true) {
+        nfds = epoll_wait(epollfd, events, APDUSOCK_MAX_EVENTS, -1);
+        if (nfds < 0) {
+            if (errno == EINTR)
+                continue;
+            printf("apdusock epoll_wait error : %s \n", strerror(errno));
+            break;
+        }
+        
+        for (i = 0; i < nfds; i++) {
+            APDUSOCK_CONN *conn = (APDUSOCK_CONN *)events[i].data.ptr;
+            
+            // listening socket
+            if (conn == nullptr) {
+                int sockfd = accept(listenfd, nullptr, nullptr);
+                if (sockfd < 0) {
+                    printf("apdusock accept error : %s \n", strerror(errno));
+                    continue;
+                }
+                conn = (APDUSOCK_CONN *)calloc(1, sizeof(APDUSOCK_CONN));
+                if (conn == nullptr) {
+                    close(sockfd);
+                    continue;
+                }
+                conn->fd = sockfd;
+                ev.events = EPOLLIN | EPOLLRDHUP;
+                ev.data.ptr = conn;
+                epoll_ctl(epollfd, EPOLL_CTL_ADD, sockfd, &ev);
+                continue;
+            }
+            
+            if ((events[i].events & (EPOLLERR | EPOLLHUP)) || apdusock_receive(conn, cb)) {
+                epoll_ctl(epollfd, EPOLL_CTL_DEL, conn->fd, nullptr);
+                close(conn->fd);
+                free(conn);
+            }
+        }
+    }
+    
+    close(epollfd);
+    close(listenfd);
+    unlink(path);
+    return 0;
+}
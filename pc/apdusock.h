@@ -0,0 +1,68 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+
+#ifndef APDUSOCK_H_
+#define APDUSOCK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "ccid.h"
+
+/* Local APDU transport. Unix stream socket, frames both ways:
+   type(1) + data length(4, big endian) + data. The reply has the type of the request. */
+#define APDUSOCK_PATH           "/tmp/solo-openpgp.sock"
+#define APDUSOCK_HEADER_SIZE    5
+#define APDUSOCK_MAX_DATA       65544
+
+#define APDUSOCK_APDU           0x01    // data: command APDU. reply: response APDU
+#define APDUSOCK_POWERON        0x02    // reply: ATR
+#define APDUSOCK_POWEROFF       0x03    // reply: empty
+#define APDUSOCK_ERROR          0xff    // reply to an unknown type
+
+static inline int apdusock_send_frame(int fd, uint8_t type, const uint8_t *data, size_t len) {
+    uint8_t hdr[APDUSOCK_HEADER_SIZE] = {type, 
+        (uint8_t)(len >> 24), (uint8_t)(len >> 16), (uint8_t)(len >> 8), (uint8_t)len};
+    struct iovec iov[2] = {{hdr, sizeof(hdr)}, {(void *)data, len}};
+    struct msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = len ? 2 : 1;
+    
+    ssize_t total = sizeof(hdr) + len;
+    return (sendmsg(fd, &msg, MSG_NOSIGNAL) == total) ? 0 : -1;
+}
+
+static inline size_t apdusock_frame_length(const uint8_t *hdr) {
+    return ((size_t)hdr[1] << 24) | ((size_t)hdr[2] << 16) | ((size_t)hdr[3] << 8) | hdr[4];
+}
+
+// blocking, for the clients. data must have APDUSOCK_MAX_DATA bytes
+static inline int apdusock_recv_frame(int fd, uint8_t *type, uint8_t *data, size_t *len) {
+    uint8_t hdr[APDUSOCK_HEADER_SIZE];
+    
+    if (recv(fd, hdr, sizeof(hdr), MSG_WAITALL) != sizeof(hdr))
+        return -1;
+    
+    *type = hdr[0];
+    *len = apdusock_frame_length(hdr);
+    if (*len > APDUSOCK_MAX_DATA)
+        return -1;
+    if (*len && recv(fd, data, *len, MSG_WAITALL) != (ssize_t)*len)
+        return -1;
+    
+    return 0;
+}
+
+extern int apdusock_start(const char *path, ex_cb cb);
+
+#endif /* APDUSOCK_H_ */
@@ -4,6 +4,13 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 #include "ccid.h"
 #include "usbip.h"
@@ -17,7 +24,7 @@ const USB_DEVICE_DESCRIPTOR dev_dsc=
     0x00,                   // Class Code
     0x00,                   // Subclass code
     0x00,                   // Protocol code
-    0x10,                   // Max packet size for EP0, see usb_config.h
+    0x40,                   // Max packet size for EP0: 64, high-speed
     0x072f,                 // Vendor ID  (1209)
     0x90cc,                 // Product ID (5070)
     0x0100,                 // Device release number in BCD format
@@ -34,7 +41,7 @@ const USB_DEVICE_QUALIFIER_DESCRIPTOR dev_qua = { // A high-speed capable device
     0x00,                   // bDeviceClass
     0x00,                   // bDeviceSubClass
     0x00,                   // bDeviceProtocol
-    CCID_DATA_PACKET_SIZE,  // bMaxPacketSize
+    0x40,                   // bMaxPacketSize0 at full speed
     0x01,                   // bNumConfigurations
     0x00                    // RFU == 0
 };
@@ -67,7 +74,7 @@ const CONFIG_CCID  configuration_ccid={{
     54,                     // bLength: 
     USB_DESCRIPTOR_ICC,     // bDescriptorType: USBDESCR_ICC 
     0x0100,                 // bcdCCID: revision 1.1 (of CCID) 
-    0x00,                   // bMaxSlotIndex: 0
+    CCID_SLOT_COUNT - 1,    // bMaxSlotIndex: one card per slot
     0x01,                   // bVoltageSupport: 5V-only
     0x00000002,             // dwProtocols: T=1 
     0x00000fa0,             // dwDefaultClock: 4000 
@@ -79,9 +86,9 @@ const CONFIG_CCID  configuration_ccid={{
     0x000000fe,             // dwMaxIFSD: 254 
     0x00000000,             // dwSynchProtocols: 0 
     0x00000000,             // dwMechanical: 0 
-    0x0002047a,             /* dwFeatures:
-                                *  Short and extended APDU level: 0x40000 ----
-                                *  Short APDU level             : 0x20000  *
+    0x0004047a,             /* dwFeatures:
+                                *  Short and extended APDU level: 0x40000  *
+                                *  Short APDU level             : 0x20000 ----
                                 *  (ICCD?)                      : 0x00800 ----
                                 *  Automatic IFSD               : 0x00400   *
                                 *  NAD value other than 0x00    : 0x00200
@@ -94,7 +101,7 @@ const CONFIG_CCID  configuration_ccid={{
                                 *  Auto activaction of ICC	    : 0x00004
                                 *  Automatic conf. based on ATR : 0x00002  *
                                 */
-    0x0000010f,             // dwMaxCCIDMessageLength: 271 
+    CCID_MAX_MESSAGE_LENGTH, // dwMaxCCIDMessageLength: 65544
     0xff,                   // bClassGetResponse: 0xff 
     0x00,                   // bClassEnvelope: 0 
     0x0000,                 // wLCDLayout: 0 
@@ -124,7 +131,7 @@ const CONFIG_CCID  configuration_ccid={{
     CCID_CMD_EP,                //EndpointAddress
     0x03,                       //bmAttributes: Interrupt
     0x0004,                     //wMaxPacketSize: 4
-    0xff                        //Interval 255ms
+    0x0c                        //Interval 2^(12-1) microframes = 256ms
     }
 };
 
@@ -196,24 +203,401 @@ const unsigned char string_4[] = { // serial number
 
 const char *configuration = (const char *)&configuration_ccid; 
 
+// the same configuration at full speed: 64 byte bulk packets, interrupt interval in frames
+static CONFIG_CCID other_speed_ccid()
+{
+    CONFIG_CCID cfg = configuration_ccid;
+    cfg.dev_conf0.bDescriptorType = USB_DESCRIPTOR_OTHER_SPEED_CONFIGURATION;
+    cfg.dev_ep0.wMaxPacketSize = CCID_FS_DATA_PACKET_SIZE;
+    cfg.dev_ep1.wMaxPacketSize = CCID_FS_DATA_PACKET_SIZE;
+    cfg.dev_ep2.bInterval = 0xff;   // 255ms
+    return cfg;
+}
+
+static const CONFIG_CCID configuration_ccid_fs = other_speed_ccid();
+const char *configuration_other_speed = (const char *)&configuration_ccid_fs;
+
 const USB_INTERFACE_DESCRIPTOR *interfaces[] = {&configuration_ccid.dev_int0};
 
 const unsigned char *strings[] = {string_0, string_1, string_2, string_3, string_4};
 
 
-#define BSIZE 2048 
-static uint8_t buffer[BSIZE + 1];
-static size_t  bsize = 0;
+#define BSIZE CCID_MAX_MESSAGE_LENGTH
+
+#define CCID_TIME_EXTENSION_MS 500
+
+// RDR_to_PC_NotifySlotChange: 2 bits per slot after the message type
+#define CCID_NOTIFY_SIZE (1 + (CCID_SLOT_COUNT * 2 + 7) / 8)
+
+static_assert(USBIP_BUSID_COUNT * CCID_SLOT_COUNT <= CCID_CARD_COUNT, "not enough cards for all the slots");
+
+typedef struct _CCID_SLOT
+{
+    bool ICCStateChanged;           // not reported to the host yet
+    bool ICCPowered;
+    bool ICCPresent;                // last seen cardremoved[] value
+}CCID_SLOT;
+
+struct _CCID_WORKER;
+
+// state of the reader attached to one USBIP connection
+typedef struct _CCID_CONNECTION
+{
+    USBIP_CONNECTION *conn;         // nullptr after detach while the worker still runs a command
+    struct _CCID_WORKER *worker;    // of the bus id
+    struct _CCID_CONNECTION *next;  // readers list
+
+    uint8_t bufferrx[BSIZE];        // bulk-OUT message split into several URBs
+    size_t  bsizerx;
+
+    uint8_t bufferin[BSIZE + 1];    // command for the worker
+    size_t  bsizein;
+
+    uint8_t bufferout[CCID_HEADER_SIZE + CCID_RESPONSE_BUFFER_SIZE];  // abData is the response buffer of ex_cb
+    size_t  bsizeout;               // response waiting for a bulk-IN URB
+    size_t  bposout;                // part of it sent already. URB may be shorter than the response
+
+    uint8_t bufferbusy[CCID_HEADER_SIZE];  // CMD_SLOT_BUSY answer, sent before the response
+    size_t  bsizebusy;
+
+    bool busy;                      // command is on the worker
+    bool done;                      // worker result is in bufferout. guarded by worker->mutex
+    size_t bsizejob;
+    uint64_t timeext;               // ms, next time extension
+
+    uint8_t cardbase;               // card of the slot 0
+    CCID_SLOT slots[CCID_SLOT_COUNT];
+}CCID_CONNECTION;
+
+// reader that ProcessCCIDTransfer works on. the usbip loop and the worker set their own.
+static thread_local CCID_CONNECTION *ccid = nullptr;
+static CCID_CONNECTION *readers = nullptr;
+
+// XfrBlock runs on the worker thread of the bus id, results come back to the usbip loop via eventfd.
+// readers of different bus ids have different cards, so their commands run in parallel.
+typedef struct _CCID_WORKER
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<CCID_CONNECTION *> jobs;
+}CCID_WORKER;
+
+static int ccid_eventfd = -1;
+static CCID_WORKER workers[USBIP_BUSID_COUNT];
+
+// set by ccid_set_card_present from any thread. zero - all the cards are inserted.
+static std::atomic<bool> cardremoved[CCID_CARD_COUNT];
+
+uint64_t ccid_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void ccid_worker(CCID_WORKER *w) {
+    while (true) {
+        CCID_CONNECTION *cc;
+        {
+            std::unique_lock<std::mutex> lock(w->mutex);
+            w->cv.wait(lock, [w]{ return !w->jobs.empty(); });
+            cc = w->jobs.front();
+            w->jobs.pop_front();
+        }
+        
+        size_t len = 0;
+        ccid = cc;
+        ProcessCCIDTransfer(cc->bufferin, cc->bsizein, cc->bufferout, &len);
+        {
+            std::lock_guard<std::mutex> lock(w->mutex);
+            cc->bsizejob = len;
+            cc->done = true;
+        }
+        
+        uint64_t one = 1;
+        if (write(ccid_eventfd, &one, sizeof(one)) != sizeof(one))
+            printf("eventfd write error : %s \n", strerror (errno));
+    }
+}
+
+int handle_device_attach(USBIP_CONNECTION *conn) {
+    CCID_CONNECTION *cc = (CCID_CONNECTION *)calloc(1, sizeof(CCID_CONNECTION));
+    if (cc == nullptr)
+        return 1;
+    
+    cc->conn = conn;
+    cc->worker = &workers[conn->busid];
+    cc->cardbase = conn->busid * CCID_SLOT_COUNT;
+    for (int i = 0; i < CCID_SLOT_COUNT; i++) {
+        cc->slots[i].ICCStateChanged = true;
+        cc->slots[i].ICCPowered = false;
+        cc->slots[i].ICCPresent = !cardremoved[cc->cardbase + i];
+    }
+    cc->next = readers;
+    readers = cc;
+    conn->data = cc;
+    char name[32];
+    usbip_busid_name(conn->busid, name);
+    printf("ccid attached to bus id %s\n", name);
+    return 0;
+}
+
+void handle_device_detach(USBIP_CONNECTION *conn) {
+    CCID_CONNECTION *cc = (CCID_CONNECTION *)conn->data;
+    
+    if (ccid == cc)
+        ccid = nullptr;
+    conn->data = nullptr;
+    char name[32];
+    usbip_busid_name(conn->busid, name);
+    printf("ccid detached from bus id %s\n", name);
+    
+    // the worker owns it until the command finishes. handle_device_events frees it then.
+    cc->conn = nullptr;
+    if (cc->busy)
+        return;
+    
+    for (CCID_CONNECTION **pcc = &readers; *pcc; pcc = &(*pcc)->next) {
+        if (*pcc == cc) {
+            *pcc = cc->next;
+            break;
+        }
+    }
+    free(cc);
+}
+
+// response ready and a bulk-IN URB is waiting
+void ccid_complete_bulkin(USBIP_CONNECTION *conn) {
+    CCID_CONNECTION *cc = (CCID_CONNECTION *)conn->data;
+    
+    if (cc->bsizebusy && usbip_urb_complete(conn, 0x04, (char *)cc->bufferbusy, cc->bsizebusy, 0) >= 0)
+        cc->bsizebusy = 0;
+
+    while (!cc->bsizebusy && !cc->busy && cc->bsizeout) {
+        int len = usbip_urb_complete(conn, 0x04, (char *)cc->bufferout + cc->bposout, cc->bsizeout - cc->bposout, 0);
+        if (len < 0)
+            return;
+        
+        cc->bposout += len;
+        if (cc->bposout >= cc->bsizeout) {
+            cc->bsizeout = 0;
+            cc->bposout = 0;
+        }
+    }
+}
+
+// command still runs. tell the host to wait instead of timing out.
+void ccid_time_extension(CCID_CONNECTION *cc) {
+    uint8_t ext[CCID_HEADER_SIZE] = {0};
+    ext[0] = RDR_TO_PC_DATABLOCK;
+    ext[5] = cc->bufferin[5];  // bSlot
+    ext[6] = cc->bufferin[6];  // bSeq
+    ext[7] = BM_COMMAND_STATUS_TIME_EXTN | BM_ICC_PRESENT_ACTIVE;
+    ext[8] = 1;                // bError: BWT multiplier
+    
+    usbip_urb_complete(cc->conn, 0x04, (char *)ext, sizeof(ext), 0);
+}
+
+bool ccid_card_present(uint8_t slot) {
+    // udp mode has one reader, so slot number is the card number
+    uint8_t card = (ccid ? ccid->cardbase : 0) + slot;
+    return card < CCID_CARD_COUNT && !cardremoved[card];
+}
+
+void ccid_set_card_present(uint8_t card, bool present) {
+    if (card >= CCID_CARD_COUNT || cardremoved[card] == !present)
+        return;
+    cardremoved[card] = !present;
+    
+    // the usbip loop picks it up in handle_device_events
+    uint64_t one = 1;
+    if (ccid_eventfd >= 0 && write(ccid_eventfd, &one, sizeof(one)) != sizeof(one))
+        printf("eventfd write error : %s \n", strerror (errno));
+}
+
+// compare slots with cardremoved[]. removed card is powered off.
+void ccid_update_card_presence(CCID_CONNECTION *cc) {
+    for (int i = 0; i < CCID_SLOT_COUNT; i++) {
+        bool present = !cardremoved[cc->cardbase + i];
+        if (cc->slots[i].ICCPresent == present)
+            continue;
+        cc->slots[i].ICCPresent = present;
+        if (!present)
+            cc->slots[i].ICCPowered = false;
+        cc->slots[i].ICCStateChanged = true;
+    }
+}
+
+// slot state changed and an interrupt URB is waiting. otherwise the URB stays parked.
+void ccid_notify_slot_change(USBIP_CONNECTION *conn) {
+    CCID_CONNECTION *cc = (CCID_CONNECTION *)conn->data;
+    
+    bool changed = false;
+    for (int i = 0; i < CCID_SLOT_COUNT; i++)
+        changed |= cc->slots[i].ICCStateChanged;
+    if (!changed || usbip_urb_pending(conn, 0x05) == 0)
+        return;
+
+    // b0 - slotN current state b1 - slotN changed state. slot N at bits 2*N
+    uint8_t notify[CCID_NOTIFY_SIZE] = {RDR_TO_PC_NOTIFYSLOTCHANGE};
+    for (int i = 0; i < CCID_SLOT_COUNT; i++) {
+        uint8_t state = cc->slots[i].ICCPresent ? ICC_PRESENT : ICC_NOT_PRESENT;
+        if (cc->slots[i].ICCStateChanged)
+            state |= ICC_CHANGE;
+        cc->slots[i].ICCStateChanged = false;
+        notify[1 + i / 4] |= state << ((i % 4) * 2);
+    }
+    usbip_urb_complete(conn, 0x05, (char*)notify, sizeof(notify), 0);
+}
 
-static uint8_t bufferout[BSIZE + 1];
-static size_t  bsizeout = 0;
+int device_events_fd(void) {
+    return ccid_eventfd;
+}
 
-bool ICCStateChanged = true;
-bool ICCPowered = false;
+int device_events_timeout(void) {
+    int64_t timeout = -1;
+    uint64_t now = ccid_now_ms();
+    
+    for (CCID_CONNECTION *cc = readers; cc; cc = cc->next) {
+        if (!cc->busy || cc->conn == nullptr)
+            continue;
+        int64_t t = (cc->timeext > now) ? cc->timeext - now : 0;
+        if (timeout < 0 || t < timeout)
+            timeout = t;
+    }
+    return timeout;
+}
+
+void handle_device_events(void) {
+    uint64_t cnt;
+    if (read(ccid_eventfd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+        printf("eventfd read error : %s \n", strerror (errno));
+    
+    uint64_t now = ccid_now_ms();
+    CCID_CONNECTION **pcc = &readers;
+    while (*pcc) {
+        CCID_CONNECTION *cc = *pcc;
+        bool done;
+        {
+            std::lock_guard<std::mutex> lock(cc->worker->mutex);
+            done = cc->done;
+            cc->done = false;
+        }
+        
+        if (done) {
+            cc->busy = false;
+            cc->bsizeout = cc->bsizejob;
+            cc->bposout = 0;
+            if (cc->conn == nullptr) {
+                *pcc = cc->next;
+                free(cc);
+                continue;
+            }
+            ccid_complete_bulkin(cc->conn);
+        } else if (cc->busy && cc->conn != nullptr && now >= cc->timeext) {
+            ccid_time_extension(cc);
+            cc->timeext = now + CCID_TIME_EXTENSION_MS;
+        }
+        
+        if (cc->conn != nullptr) {
+            ccid_update_card_presence(cc);
+            ccid_notify_slot_change(cc->conn);
+        }
+        pcc = &cc->next;
+    }
+}
 
-bool ProcessCCIDTransfer(uint8_t *datain, size_t datainlen, uint8_t *dataout, size_t *dataoutlen);
+// XfrBlock goes to the worker, the other commands are answered right away
+void ccid_process_command(USBIP_CONNECTION *conn, USBIP_RET_SUBMIT *usb_req, char *data, int bl) {
+    CCID_CONNECTION *cc = (CCID_CONNECTION *)conn->data;
+    
+    if (cc->busy) {
+        // bMaxCCIDBusySlots = 1
+        if (bl < CCID_HEADER_SIZE) {
+            send_usb_req(conn, usb_req, nullptr, 0, 1);
+            return;
+        }
+        memset(cc->bufferbusy, 0, CCID_HEADER_SIZE);
+        cc->bufferbusy[0] = RDR_TO_PC_SLOTSTATUS;
+        cc->bufferbusy[5] = data[5];
+        cc->bufferbusy[6] = data[6];
+        cc->bufferbusy[7] = BM_COMMAND_STATUS_FAILED | BM_ICC_PRESENT_ACTIVE;
+        cc->bufferbusy[8] = SLOTERROR_CMD_SLOT_BUSY;
+        cc->bsizebusy = CCID_HEADER_SIZE;
+        send_usb_req(conn, usb_req, nullptr, 0, 0);
+        ccid_complete_bulkin(conn);
+        return;
+    }
+    
+    if (bl >= CCID_HEADER_SIZE && bl <= BSIZE && data[0] == PC_TO_RDR_XFRBLOCK) {
+        memcpy(cc->bufferin, data, bl);
+        cc->bsizein = bl;
+        cc->bsizeout = 0;
+        cc->bposout = 0;
+        cc->busy = true;
+        cc->timeext = ccid_now_ms() + CCID_TIME_EXTENSION_MS;
+        {
+            std::lock_guard<std::mutex> lock(cc->worker->mutex);
+            cc->worker->jobs.push_back(cc);
+        }
+        cc->worker->cv.notify_one();
+        // ACK
+        send_usb_req(conn, usb_req, nullptr, 0, 0);
+        return;
+    }
+    
+    ccid = cc;
+    cc->bposout = 0;
+    bool res = ProcessCCIDTransfer((uint8_t *)data, bl, cc->bufferout, &cc->bsizeout);
+    // ACK
+    send_usb_req(conn, usb_req, nullptr, 0, res ? 0 : 1);
+    
+    ccid_complete_bulkin(conn);
+    ccid_notify_slot_change(conn);
+}
 
-void handle_data(int sockfd, USBIP_RET_SUBMIT *usb_req, int bl) {  
+// CCID message length from its header, 0 if the header is not complete
+size_t ccid_message_length(const uint8_t *data, size_t len) {
+    if (len < CCID_HEADER_SIZE)
+        return 0;
+    return CCID_HEADER_SIZE + ((size_t)data[1] | ((size_t)data[2] << 8) | ((size_t)data[3] << 16) | ((size_t)data[4] << 24));
+}
+
+// the host may split a message into several URBs of whole packets. it ends when dwLength bytes
+// are received or with a short packet.
+void ccid_receive_bulkout(USBIP_CONNECTION *conn, USBIP_RET_SUBMIT *usb_req, char *data, int bl) {
+    CCID_CONNECTION *cc = (CCID_CONNECTION *)conn->data;
+    bool shortpacket = (bl % CCID_DATA_PACKET_SIZE) != 0 || bl == 0;
+    
+    // whole message in one URB. no copy
+    if (cc->bsizerx == 0) {
+        size_t msglen = ccid_message_length((uint8_t *)data, bl);
+        if (shortpacket || (msglen && (size_t)bl >= msglen)) {
+            ccid_process_command(conn, usb_req, data, bl);
+            return;
+        }
+    }
+    
+    if (cc->bsizerx + bl > BSIZE) {
+        printf("ccid message too long\n");
+        cc->bsizerx = 0;
+        send_usb_req(conn, usb_req, nullptr, 0, 1);
+        return;
+    }
+    memcpy(cc->bufferrx + cc->bsizerx, data, bl);
+    cc->bsizerx += bl;
+    
+    size_t msglen = ccid_message_length(cc->bufferrx, cc->bsizerx);
+    if (shortpacket || (msglen && cc->bsizerx >= msglen)) {
+        size_t len = cc->bsizerx;
+        cc->bsizerx = 0;
+        ccid_process_command(conn, usb_req, (char *)cc->bufferrx, len);
+        return;
+    }
+    // ACK, wait for the rest
+    send_usb_req(conn, usb_req, nullptr, 0, 0);
+}
+
+void handle_data(USBIP_CONNECTION *conn, USBIP_RET_SUBMIT *usb_req, char *data, int bl) {  
     // data channel
     if(usb_req->ep == 0x04)
     {  
@@ -226,19 +610,18 @@ void handle_data(int sockfd, USBIP_RET_SUBMIT *usb_req, int bl) {
 #ifdef _DEBUGCLI
             printf("EP4 direction=input\n");
 #endif // _DEBUGCLI
-            bsize=recv (sockfd, (char *)buffer, bl, 0);
-                        
-            bool res = ProcessCCIDTransfer(buffer, bsize, bufferout, &bsizeout);
-            // ACK
-            send_usb_req(sockfd, usb_req, nullptr, 0, res ? 0 : 1);
+            ccid_receive_bulkout(conn, usb_req, data, bl);
         }
         else
         {    
 #ifdef _DEBUGCLI
             printf("EP4 direction=output\n");
 #endif // _DEBUGCLI
-            send_usb_req(sockfd, usb_req, (char *)bufferout, bsizeout, 0);
-            bsizeout = 0;
+            // wait for the response from the card
+            if (usbip_urb_park(conn, usb_req, bl) == 0)
+                ccid_complete_bulkin(conn);
+            else
+                send_usb_req(conn, usb_req, nullptr, 0, -ENOMEM);
        }
      }
   
@@ -250,18 +633,17 @@ void handle_data(int sockfd, USBIP_RET_SUBMIT *usb_req, int bl) {
         if(usb_req->direction == 0) { 
             printf("EP5 direction=input. WARNNING!!!!\n");
             //not supported
-            send_usb_req(sockfd, usb_req, nullptr, 0, 0);
+            send_usb_req(conn, usb_req, nullptr, 0, 0);
             //usleep(500);
         } else {
 #ifdef _DEBUGCLI
             printf("EP5 direction=output\n");
 #endif // _DEBUGCLI
-
-            // b0 - slot0 current state b1 - slot0 changed state
-            uint8_t state = (ICCPowered ? ICC_PRESENT : ICC_NOT_PRESENT) | (ICCStateChanged ? ICC_CHANGE : 0x00);
-            uint8_t data[] = {RDR_TO_PC_NOTIFYSLOTCHANGE, state}; 
-            ICCStateChanged = false;
-            send_usb_req(sockfd, usb_req, (char*)data, 2, 0);
+            // completes when the slot state changes
+            if (usbip_urb_park(conn, usb_req, bl) == 0)
+                ccid_notify_slot_change(conn);
+            else
+                send_usb_req(conn, usb_req, nullptr, 0, -ENOMEM);
         }
     }
 };
@@ -281,50 +663,60 @@ LINE_CODING linec;
 
 unsigned short linecs=0;
 
-void handle_unknown_control(int sockfd, StandardDeviceRequest * control_req, USBIP_RET_SUBMIT *usb_req)
+void handle_unknown_control(USBIP_CONNECTION *conn, StandardDeviceRequest * control_req, USBIP_RET_SUBMIT *usb_req, char *data)
 {
         if(control_req->bmRequestType == 0x21)//Abstract Control Model Requests
         { 
           if(control_req->bRequest == 0x20)  //SET_LINE_CODING
           {
             printf("SET_LINE_CODING\n");   
-            if ((recv (sockfd, (char *) &linec , control_req->wLength, 0)) != control_req->wLength)
-            {
-              printf ("receive error : %s \n", strerror (errno));
-              exit(-1);
-            };
-            send_usb_req(sockfd,usb_req,nullptr,0,0);
+            memcpy(&linec, data, min(control_req->wLength, sizeof(linec)));
+            send_usb_req(conn,usb_req,nullptr,0,0);
           } 
           if(control_req->bRequest == 0x21)  //GET_LINE_CODING
           {
             printf("GET_LINE_CODING\n");  
-            send_usb_req(sockfd,usb_req,(char *)&linec,7,0);
+            send_usb_req(conn,usb_req,(char *)&linec,7,0);
           }
           if(control_req->bRequest == 0x22)  //SET_LINE_CONTROL_STATE
           {
             linecs=control_req->wValue0;
             printf("SET_LINE_CONTROL_STATE 0x%02X\n", linecs);   
-            send_usb_req(sockfd,usb_req,nullptr,0,0);
+            send_usb_req(conn,usb_req,nullptr,0,0);
           }
           if(control_req->bRequest == 0x23)  //SEND_BREAK
           {
             printf("SEND_BREAK\n");   
-            send_usb_req(sockfd,usb_req,nullptr,0,0);
+            send_usb_req(conn,usb_req,nullptr,0,0);
           }
         } 
 
 };
 
 static ex_cb exchange_callback = nullptr;
-int usbip_ccid_start(ex_cb cb) {
+void ccid_set_exchange_callback(ex_cb cb) {
     exchange_callback = cb;
+}
+
+int usbip_ccid_start(int port, int bus, ex_cb cb) {
+    exchange_callback = cb;
+    
+    ccid_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ccid_eventfd < 0) {
+        printf("eventfd error : %s \n", strerror (errno));
+        return 1;
+    }
+    for (int i = 0; i < USBIP_BUSID_COUNT; i++)
+        std::thread(ccid_worker, &workers[i]).detach();
+    
     printf("ccid started....\n");
-    usbip_run(&dev_dsc);
+    usbip_run(&dev_dsc, port, bus);
     printf("ccid stopped....\n");
     return 0;
 }
 
-#define ABDATA_SIZE 261
+#define ABDATA_SIZE (CCID_MAX_MESSAGE_LENGTH - CCID_HEADER_SIZE)
+static_assert(CCID_MAX_APDU_LENGTH == ABDATA_SIZE, "ccid.h and usbip.h differ");
 
 typedef struct { 
     uint8_t bMessageType; /* Offset = 0*/
@@ -360,6 +752,13 @@ static const uint8_t atrconst[] = {
     0x1F, 0x03, 0x00, 0x31, 0x84, 0x73, 0x80, 0x01, 
     0x80, 0x00, 0x90, 0x00, 0xE4 };
 
+size_t ccid_get_atr(uint8_t *atr, size_t maxlen) {
+    if (maxlen < sizeof(atrconst))
+        return 0;
+    memmove(atr, atrconst, sizeof(atrconst));
+    return sizeof(atrconst);
+}
+
 void CCID_UpdateResponseStatus(CCID_bulkout_data_t *pckout, uint8_t status, uint8_t error) {
     pckout->bStatus = status;
     pckout->bError = error;
@@ -372,9 +771,17 @@ void PC_to_RDR_IccPowerOn(CCID_bulkin_data_t *pckin, CCID_bulkout_data_t *pckout
         CCID_UpdateResponseStatus(pckout, BM_COMMAND_STATUS_FAILED | BM_ICC_PRESENT_ACTIVE, SLOTERROR_BAD_POWERSELECT);
         return; 
     }
+    
+    if (!ccid_card_present(pckin->bSlot)) {
+        CCID_UpdateResponseStatus(pckout, BM_COMMAND_STATUS_FAILED | BM_ICC_NO_ICC_PRESENT, SLOTERROR_ICC_MUTE);
+        return;
+    }
 
-    ICCPowered = true;
-    ICCStateChanged = true;
+    // no reader state in udp mode. repeated power on is not a change.
+    if (ccid && !ccid->slots[pckin->bSlot].ICCPowered) {
+        ccid->slots[pckin->bSlot].ICCPowered = true;
+        ccid->slots[pckin->bSlot].ICCStateChanged = true;
+    }
     
     pckout->dwLength = sizeof(atrconst);
     memmove(pckout->abData, atrconst, sizeof(atrconst));
@@ -383,20 +790,35 @@ void PC_to_RDR_IccPowerOn(CCID_bulkin_data_t *pckin, CCID_bulkout_data_t *pckout
 };
 
 void PC_to_RDR_IccPowerOff(CCID_bulkin_data_t *pckin, CCID_bulkout_data_t *pckout) {
-	ICCPowered = false;
-    ICCStateChanged = true;
-    CCID_UpdateResponseStatus(pckout, BM_COMMAND_STATUS_NO_ERROR | BM_ICC_NO_ICC_PRESENT, SLOT_NO_ERROR);
+    if (ccid && ccid->slots[pckin->bSlot].ICCPowered) {
+        ccid->slots[pckin->bSlot].ICCPowered = false;
+        ccid->slots[pckin->bSlot].ICCStateChanged = true;
+    }
+    uint8_t icc = ccid_card_present(pckin->bSlot) ? BM_ICC_PRESENT_INACTIVE : BM_ICC_NO_ICC_PRESENT;
+    CCID_UpdateResponseStatus(pckout, BM_COMMAND_STATUS_NO_ERROR | icc, SLOT_NO_ERROR);
 };
 
 void PC_to_RDR_GetSlotStatus(CCID_bulkin_data_t *pckin, CCID_bulkout_data_t *pckout) {
+    uint8_t icc = BM_ICC_PRESENT_ACTIVE;
+    if (!ccid_card_present(pckin->bSlot))
+        icc = BM_ICC_NO_ICC_PRESENT;
+    else if (ccid && !ccid->slots[pckin->bSlot].ICCPowered)
+        icc = BM_ICC_PRESENT_INACTIVE;
     
-    CCID_UpdateResponseStatus(pckout,  BM_COMMAND_STATUS_NO_ERROR | BM_ICC_PRESENT_ACTIVE, SLOT_NO_ERROR);
+    CCID_UpdateResponseStatus(pckout,  BM_COMMAND_STATUS_NO_ERROR | icc, SLOT_NO_ERROR);
 };
 
 void PC_to_RDR_XfrBlock(CCID_bulkin_data_t *pckin, CCID_bulkout_data_t *pckout) {
     
+    if (!ccid_card_present(pckin->bSlot)) {
+        CCID_UpdateResponseStatus(pckout, BM_COMMAND_STATUS_FAILED | BM_ICC_NO_ICC_PRESENT, SLOTERROR_ICC_MUTE);
+        return;
+    }
+    
+    uint8_t card = (ccid ? ccid->cardbase : 0) + pckin->bSlot;
+    
     size_t len = 0;
-    exchange_callback(pckin->abData, pckin->dwLength, pckout->abData, &len);
+    exchange_callback(card, pckin->abData, pckin->dwLength, pckout->abData, &len);
     pckout->dwLength = len;
     
     CCID_UpdateResponseStatus(pckout, BM_COMMAND_STATUS_NO_ERROR | BM_ICC_PRESENT_ACTIVE, SLOT_NO_ERROR);
@@ -441,7 +863,7 @@ bool ProcessCCIDTransfer(uint8_t *datain, size_t datainlen, uint8_t *dataout, si
     
     CCID_bulkin_data_t *sdatain = (CCID_bulkin_data_t *)datain;
     
-    if (sdatain->dwLength + CCID_HEADER_SIZE != datainlen)
+    if (sdatain->dwLength + CCID_HEADER_SIZE != datainlen || sdatain->dwLength > ABDATA_SIZE)
         return false;
     
     // structures vice versa!    
@@ -450,6 +872,13 @@ bool ProcessCCIDTransfer(uint8_t *datain, size_t datainlen, uint8_t *dataout, si
     sdataout->bSlot = sdatain->bSlot;
     sdataout->bSeq = sdatain->bSeq;
     
+    if (sdatain->bSlot >= CCID_SLOT_COUNT) {
+        CCID_UpdateResponseStatus(sdataout, BM_COMMAND_STATUS_FAILED | BM_ICC_NO_ICC_PRESENT, SLOTERROR_BAD_SLOT);
+        RDR_to_PC_SlotStatus(sdataout);
+        *dataoutlen = CCID_HEADER_SIZE;
+        return true;
+    }
+    
     switch (sdatain->bMessageType) {
     case PC_TO_RDR_ICCPOWERON:
         PC_to_RDR_IccPowerOn(sdatain, sdataout);
@@ -12,11 +12,33 @@
 #define CCID_H_
 
 #include <stdint.h>
+#include <stddef.h>
 
-/* reg_callback.h */
-typedef void (*ex_cb)(uint8_t*, size_t, uint8_t*, size_t*);
+// slots of one usbip reader. each slot is a separate card.
+#define CCID_SLOT_COUNT 4
+// card = usbip bus id * CCID_SLOT_COUNT + slot
+#define CCID_CARD_COUNT 16
 
-extern int usbip_ccid_start(ex_cb cb);
+/* reg_callback.h */
+// card, apdu, apdu length, response, response length
+typedef void (*ex_cb)(uint8_t, uint8_t*, size_t, uint8_t*, size_t*);
+// longest response of ex_cb: dwMaxCCIDMessageLength without the ccid header
+#define CCID_MAX_APDU_LENGTH (65544 - 10)
+// response buffer of ex_cb has at least this size: the card builds the largest
+// extended response in place, see APDUExecutor::Execute
+#define CCID_RESPONSE_BUFFER_SIZE (0x10000 + 2)
+
+#define UDPCCID_PORT 8111
+
+// port - usbip tcp port, bus - bus ids <bus>-1..<bus>-USBIP_BUSID_COUNT
+extern int usbip_ccid_start(int port, int bus, ex_cb cb);
+extern size_t ccid_get_atr(uint8_t *atr, size_t maxlen);
+extern int udp_ccid_start(int port, ex_cb cb);
+
+extern void ccid_set_exchange_callback(ex_cb cb);
+// insert/remove the card. thread safe, readers get RDR_to_PC_NotifySlotChange.
+extern void ccid_set_card_present(uint8_t card, bool present);
+extern bool ProcessCCIDTransfer(uint8_t *datain, size_t datainlen, uint8_t *dataout, size_t *dataoutlen);
 
 
 
@@ -0,0 +1,301 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "trace.h"
+#include "usbip.h"
+#include "apdusock.h"
+#include "shmring.h"
+#include "tracedrain.h"
+
+SOLO_CONFIG solo_config;
+
+static bool attachcmdset = false;
+
+enum {
+    OPT_CONFIG = 0x100,
+    OPT_DATADIR,
+    OPT_FSFILE,
+    OPT_FSSIZE,
+    OPT_MODE,
+    OPT_USBIPPORT,
+    OPT_USBIPBUS,
+    OPT_ATTACHCMD,
+    OPT_UDPPORT,
+    OPT_APDUSOCK,
+    OPT_SHMNAME,
+    OPT_CAPTUREFILE,
+    OPT_TRACELEVEL,
+    OPT_TRACEFILE,
+    OPT_HELP,
+};
+
+static const struct option options[] = {
+    {"config",        required_argument, nullptr, OPT_CONFIG},
+    {"data-dir",      required_argument, nullptr, OPT_DATADIR},
+    {"fs-file",       required_argument, nullptr, OPT_FSFILE},
+    {"fs-size",       required_argument, nullptr, OPT_FSSIZE},
+    {"mode",          required_argument, nullptr, OPT_MODE},
+    {"usbip-port",    required_argument, nullptr, OPT_USBIPPORT},
+    {"usbip-bus",     required_argument, nullptr, OPT_USBIPBUS},
+    {"attach-cmd",    required_argument, nullptr, OPT_ATTACHCMD},
+    {"udp-port",      required_argument, nullptr, OPT_UDPPORT},
+    {"apdusock-path", required_argument, nullptr, OPT_APDUSOCK},
+    {"shm-name",      required_argument, nullptr, OPT_SHMNAME},
+    {"capture-file",  required_argument, nullptr, OPT_CAPTUREFILE},
+    {"trace-level",   required_argument, nullptr, OPT_TRACELEVEL},
+    {"trace-file",    required_argument, nullptr, OPT_TRACEFILE},
+    {"help",          no_argument,       nullptr, OPT_HELP},
+    {nullptr,         0,                 nullptr, 0},
+};
+
+static void config_defaults() {
+    memset(&solo_config, 0, sizeof(solo_config));
+    strcpy(solo_config.datadir, "./data");
+    strcpy(solo_config.fsfile, "filesystem.spiffs");
+    solo_config.fssize = 0;     // config_fs_needed or the size of the existing image
+    solo_config.mode = CONFIG_MODE_USBIP;
+    solo_config.usbipport = TCP_SERV_PORT;
+    solo_config.usbipbus = 1;
+    solo_config.udpport = UDPCCID_PORT;
+    strcpy(solo_config.apdusock, APDUSOCK_PATH);
+    strcpy(solo_config.shmname, SHMAPDU_NAME);
+    solo_config.tracelevel = Trace::Info;
+    strcpy(solo_config.tracefile, TRACEDRAIN_STDOUT);
+}
+
+static void config_usage(const char *name) {
+    printf("usage: %s [options]\n", name);
+    printf("  --config FILE         key = value lines with the option names below\n");
+    printf("  --data-dir DIR        files of the card. default ./data\n");
+    printf("  --fs-file NAME        flash image in data-dir. default filesystem.spiffs\n");
+    printf("  --fs-size BYTES       flash image size, multiple of %d. default %d per card, or the existing image\n",
+            CONFIG_FS_BLOCK_SIZE, CONFIG_FS_CARD_SIZE);
+    printf("  --mode usbip|udp      CCID transport. default usbip\n");
+    printf("  --usbip-port PORT     default %d\n", TCP_SERV_PORT);
+    printf("  --usbip-bus N         bus ids N-1..N-%d. default 1\n", USBIP_BUSID_COUNT);
+    printf("  --attach-cmd CMD      run after start. empty - none. default: sudo usbip attach of <bus>-1\n");
+    printf("  --udp-port PORT       default %d\n", UDPCCID_PORT);
+    printf("  --apdusock-path PATH  empty - disabled. default %s\n", APDUSOCK_PATH);
+    printf("  --shm-name NAME       empty - disabled. default %s\n", SHMAPDU_NAME);
+    printf("  --capture-file PATH   flash image and all apdu pairs for apdureplay. default none\n");
+    printf("  --trace-level LEVEL   none|error|info|debug. compiled up to %d. default info\n", TRACE_LEVEL);
+    printf("  --trace-file PATH     binary trace for tools/tracedump. %s - text to stdout, default.\n", TRACEDRAIN_STDOUT);
+    printf("                        empty - kept in memory, SIGUSR2 saves it to data-dir/%s\n", TRACEDRAIN_DUMP_FILE);
+}
+
+static int config_copy(char *dst, const char *value) {
+    if (strlen(value) >= CONFIG_PATH_SIZE) {
+        printf("config: value too long: %s\n", value);
+        return 1;
+    }
+    strcpy(dst, value);
+    return 0;
+}
+
+static int config_number(const char *value, long min, long max, long *res) {
+    char *end = nullptr;
+    *res = strtol(value, &end, 0);
+    if (end == value || *end != '\0' || *res < min || *res > max) {
+        printf("config: wrong number: %s\n", value);
+        return 1;
+    }
+    return 0;
+}
+
+static int config_set(int opt, const char *value) {
+    long n = 0;
+
+    switch (opt) {
+    case OPT_DATADIR:
+        return config_copy(solo_config.datadir, value);
+    case OPT_FSFILE:
+        return config_copy(solo_config.fsfile, value);
+    case OPT_FSSIZE:
+        if (config_number(value, CONFIG_FS_MIN_SIZE, 64 * 1024 * 1024, &n))
+            return 1;
+        if (n % CONFIG_FS_BLOCK_SIZE) {
+            printf("config: fs-size must be a multiple of %d\n", CONFIG_FS_BLOCK_SIZE);
+            return 1;
+        }
+        solo_config.fssize = n;
+        return 0;
+    case OPT_MODE:
+        if (strcmp(value, "usbip") == 0)
+            solo_config.mode = CONFIG_MODE_USBIP;
+        else if (strcmp(value, "udp") == 0)
+            solo_config.mode = CONFIG_MODE_UDP;
+        else {
+            printf("config: wrong mode: %s\n", value);
+            return 1;
+        }
+        return 0;
+    case OPT_USBIPPORT:
+        if (config_number(value, 1, 65535, &n))
+            return 1;
+        solo_config.usbipport = n;
+        return 0;
+    case OPT_USBIPBUS:
+        if (config_number(value, 1, 127, &n))
+            return 1;
+        solo_config.usbipbus = n;
+        return 0;
+    case OPT_ATTACHCMD:
+        attachcmdset = true;
+        return config_copy(solo_config.attachcmd, value);
+    case OPT_UDPPORT:
+        if (config_number(value, 1, 65535, &n))
+            return 1;
+        solo_config.udpport = n;
+        return 0;
+    case OPT_APDUSOCK:
+        return config_copy(solo_config.apdusock, value);
+    case OPT_SHMNAME:
+        return config_copy(solo_config.shmname, value);
+    case OPT_CAPTUREFILE:
+        return config_copy(solo_config.capturefile, value);
+    case OPT_TRACELEVEL: {
+        static const char *levels[] = {"none", "error", "info", "debug"};
+        for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++)
+            if (strcmp(value, levels[i]) == 0) {
+                solo_config.tracelevel = i;
+                return 0;
+            }
+        if (config_number(value, Trace::None, Trace::Debug, &n))
+            return 1;
+        solo_config.tracelevel = n;
+        return 0;
+    }
+    case OPT_TRACEFILE:
+        return config_copy(solo_config.tracefile, value);
+    default:
+        return 1;
+    }
+}
+
+static char *config_trim(char *s) {
+    while (isspace((unsigned char)*s))
+        s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+        *--end = '\0';
+    return s;
+}
+
+static int config_load_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == nullptr) {
+        printf("config: can't open %s\n", path);
+        return 1;
+    }
+
+    char line[CONFIG_PATH_SIZE * 2];
+    int lineno = 0;
+    int res = 0;
+    while (res == 0 && fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+        char *key = config_trim(line);
+        if (*key == '\0')
+            continue;
+
+        char *eq = strchr(key, '=');
+        const struct option *o = nullptr;
+        if (eq) {
+            *eq = '\0';
+            key = config_trim(key);
+            for (o = options; o->name; o++)
+                if (strcmp(o->name, key) == 0 && o->has_arg == required_argument && o->val != OPT_CONFIG)
+                    break;
+        }
+        if (o == nullptr || o->name == nullptr) {
+            printf("config: %s:%d: unknown setting\n", path, lineno);
+            res = 1;
+            break;
+        }
+        res = config_set(o->val, config_trim(eq + 1));
+    }
+
+    fclose(f);
+    return res;
+}
+
+int config_load(int argc, char *argv[]) {
+    config_defaults();
+
+    // config file first, so the command line overrides it
+    int opt;
+    opterr = 0;
+    while ((opt = getopt_long(argc, argv, "", options, nullptr)) != -1)
+        if (opt == OPT_CONFIG && config_load_file(optarg))
+            return 1;
+
+    optind = 1;
+    opterr = 1;
+    while ((opt = getopt_long(argc, argv, "", options, nullptr)) != -1) {
+        if (opt == OPT_CONFIG)
+            continue;
+        if (opt == OPT_HELP || opt == '?' || config_set(opt, optarg)) {
+            config_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc) {
+        config_usage(argv[0]);
+        return 1;
+    }
+
+    // an existing image of the other size would be formatted, so by default it is kept as it is
+    size_t needed = config_fs_needed();
+    if (solo_config.fssize == 0) {
+        char path[CONFIG_PATH_SIZE * 2];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", solo_config.datadir, solo_config.fsfile);
+        if (stat(path, &st) == 0 && st.st_size >= CONFIG_FS_MIN_SIZE && st.st_size % CONFIG_FS_BLOCK_SIZE == 0)
+            solo_config.fssize = st.st_size;
+        else
+            solo_config.fssize = needed;
+        if (solo_config.fssize < needed)
+            printf("config: WARNING %s has %zu bytes, space for %zu of %zu cards. --fs-size %zu formats it for all\n",
+                    path, solo_config.fssize, solo_config.fssize / CONFIG_FS_CARD_SIZE, needed / CONFIG_FS_CARD_SIZE, needed);
+    } else if (solo_config.fssize < needed) {
+        printf("config: fs-size %zu is too small for %zu cards, at least %zu\n",
+                solo_config.fssize, needed / CONFIG_FS_CARD_SIZE, needed);
+        return 1;
+    }
+
+    if (!attachcmdset)
+        snprintf(solo_config.attachcmd, sizeof(solo_config.attachcmd),
+                "sudo usbip --tcp-port %d attach -r 127.0.0.1 -b %d-1", solo_config.usbipport, solo_config.usbipbus);
+
+    return 0;
+}
+
+size_t config_fs_needed() {
+    // udp: one reader, slot number is the card number. usbip: all the slots of all the bus ids
+    size_t cards = (solo_config.mode == CONFIG_MODE_UDP) ? CCID_SLOT_COUNT : CCID_CARD_COUNT;
+    return cards * CONFIG_FS_CARD_SIZE;
+}
+
+void config_data_path(char *path, size_t maxlen, const char *name) {
+    if (access(solo_config.datadir, F_OK) != 0)
+        mkdir(solo_config.datadir, 0777);
+
+    snprintf(path, maxlen, "%s/%s", solo_config.datadir, name);
+}
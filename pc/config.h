@@ -0,0 +1,55 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+
+#ifndef CONFIG_H_
+#define CONFIG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CONFIG_PATH_SIZE        256
+#define CONFIG_FS_BLOCK_SIZE    2048            // spiffs erase block
+#define CONFIG_FS_CARD_SIZE     (10 * CONFIG_FS_BLOCK_SIZE)   // files of one card with 3 RSA keys
+#define CONFIG_FS_MIN_SIZE      CONFIG_FS_CARD_SIZE
+
+#define CONFIG_MODE_USBIP       0
+#define CONFIG_MODE_UDP         1
+
+/* Settings of one card process. Several processes can run side by side with their own
+   data directory, ports and socket names.
+   Sources in priority order: command line, config file (--config), defaults.
+   Config file: "key = value" lines with the command line option names, "#" - comment. */
+typedef struct _SOLO_CONFIG
+{
+    char datadir[CONFIG_PATH_SIZE];     // data-dir      ./data
+    char fsfile[CONFIG_PATH_SIZE];      // fs-file       filesystem.spiffs, in data-dir
+    size_t fssize;                      // fs-size       20480 per card in use, multiple of 2048. see config_fs_needed
+    int mode;                           // mode          usbip | udp
+    int usbipport;                      // usbip-port    3240
+    int usbipbus;                       // usbip-bus     1. bus ids <bus>-1..<bus>-4
+    char attachcmd[CONFIG_PATH_SIZE];   // attach-cmd    usbip attach to itself. empty - do not attach
+    int udpport;                        // udp-port      8111
+    char apdusock[CONFIG_PATH_SIZE];    // apdusock-path /tmp/solo-openpgp.sock. empty - disabled
+    char shmname[CONFIG_PATH_SIZE];     // shm-name      /solo-openpgp-shm. empty - disabled
+    int tracelevel;                     // trace-level   none | error | info | debug. info
+    char capturefile[CONFIG_PATH_SIZE]; // capture-file  apdu pairs for tools/apdureplay. empty - disabled
+    char tracefile[CONFIG_PATH_SIZE];   // trace-file    "-" - text to stdout. empty - ring only, SIGUSR2 dumps it
+}SOLO_CONFIG;
+
+extern SOLO_CONFIG solo_config;
+
+// defaults, config file, command line. returns non zero if the program must exit.
+extern int config_load(int argc, char *argv[]);
+// flash image size for all the cards of the mode: they keep their files in one image
+extern size_t config_fs_needed();
+// path of the file in data-dir. creates data-dir.
+extern void config_data_path(char *path, size_t maxlen, const char *name);
+
+#endif /* CONFIG_H_ */
@@ -2,10 +2,8 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <netinet/in.h>
 #include <time.h>
 #include <string.h>
 #include <unistd.h>
@@ -13,14 +11,16 @@
 #include <fcntl.h>
 #include <dirent.h>
 #include <fnmatch.h>
+#include <mutex>
+
+#include "config.h"
 
 #define SPIFFS_MODE
 
 #ifdef SPIFFS_MODE
 #include <spiffs.h>
 static spiffs fs;
-static uint8_t fsbuf[2048*10] = {0};
-static char *SpiffsFileName = (char *)"filesystem.spiffs";
+static uint8_t *fsbuf = nullptr;  // flash image, solo_config.fssize bytes
 #endif
 
 #define LOG_PAGE_SIZE 64
@@ -30,6 +30,9 @@ int ireadfile(char* name, uint8_t * buf, size_t max_size, size_t *size);
 int iwritefile(char* name, uint8_t * buf, size_t size);
 int sprintfs();
 
+// cards of different readers run in parallel threads and share the flash image
+static std::mutex fsmutex;
+
 static u8_t spiffs_work_buf[LOG_PAGE_SIZE * 2];
 static u8_t spiffs_fds[32 * 4];
 static u8_t spiffs_cache_buf[(LOG_PAGE_SIZE + 32) * 4];
@@ -51,10 +54,10 @@ static s32_t hw_spiffs_erase(u32_t addr, u32_t size) {
 
 void hw_spiffs_mount() {
 	spiffs_config cfg;
-	cfg.phys_size = 10*2048; // use all spi flash
+	cfg.phys_size = solo_config.fssize; // use all spi flash
 	cfg.phys_addr = 0;       // start spiffs at start of spi flash
-	cfg.phys_erase_block = 2048; // according to datasheet
-	cfg.log_block_size = 2048;   // let us not complicate things
+	cfg.phys_erase_block = CONFIG_FS_BLOCK_SIZE; // according to datasheet
+	cfg.log_block_size = CONFIG_FS_BLOCK_SIZE;   // let us not complicate things
 	cfg.log_page_size = LOG_PAGE_SIZE; // as we said
 
 	cfg.hal_read_f = hw_spiffs_read;
@@ -85,13 +88,18 @@ void hw_spiffs_mount() {
 
 int hwinit() {
 #ifdef SPIFFS_MODE
-	memset(fsbuf, 0xff, sizeof(fsbuf));
+	fsbuf = (uint8_t *)malloc(solo_config.fssize);
+	if (fsbuf == nullptr)
+		return 1;
+	memset(fsbuf, 0xff, solo_config.fssize);
 
-	if (ifileexist(SpiffsFileName)) {
+	if (ifileexist(solo_config.fsfile)) {
 		size_t size = 0;
-		ireadfile(SpiffsFileName, fsbuf, sizeof(fsbuf), &size);
-		if (size != sizeof(fsbuf))
-			memset(fsbuf, 0xff, sizeof(fsbuf));
+		ireadfile(solo_config.fsfile, fsbuf, solo_config.fssize, &size);
+		if (size != solo_config.fssize) {
+			printf("%s size %zu, expected %zu. formatting\n", solo_config.fsfile, size, solo_config.fssize);
+			memset(fsbuf, 0xff, solo_config.fssize);
+		}
 
 		printf("Loaded OK\n");
 	}
@@ -102,118 +110,24 @@ int hwinit() {
 	return 0;
 }
 
-int spiffs_save() {
-	return iwritefile(SpiffsFileName, fsbuf, sizeof(fsbuf));
-}
-
-
-int udp_server()
-{
-    static int run_already = 0;
-    static int fd = -1;
-    if (run_already && fd >= 0) return fd;
-    run_already = 1;
-
-    if ( (fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ) {
-        perror( "socket failed" );
-        return 1;
-    }
-
-    struct timeval read_timeout;
-    read_timeout.tv_sec = 0;
-    read_timeout.tv_usec = 10;
-    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &read_timeout, sizeof(struct timeval)) != 0)
-    {
-        perror( "setsockopt" );
-        exit(1);
-    }
-
-    struct sockaddr_in serveraddr;
-    memset( &serveraddr, 0, sizeof(serveraddr) );
-    serveraddr.sin_family = AF_INET;
-    serveraddr.sin_port = htons( 8111 );
-    serveraddr.sin_addr.s_addr = htonl( INADDR_ANY );
-
-    if ( bind(fd, (struct sockaddr *)&serveraddr, sizeof(serveraddr)) < 0 ) {
-        perror( "bind failed" );
-        exit(1);
-    }
-    return fd;
-}
-
-int udp_recv(int fd, uint8_t * buf, int size)
-{
-
-    fd_set         input;
-    FD_ZERO(&input);
-    FD_SET(fd, &input);
-    struct timeval timeout;
-    timeout.tv_sec  = 0;
-    timeout.tv_usec = 100;
-    int n = select(fd + 1, &input, NULL, NULL, &timeout);
-    if (n == -1) {
-        perror("select\n");
-        exit(1);
-    } else if (n == 0)
-        return 0;
-    if (!FD_ISSET(fd, &input))
-    {
-
-    }
-    int length = recvfrom( fd, buf, size, 0, NULL, 0 );
-    if ( length < 0 ) {
-        perror( "recvfrom failed" );
-        exit(1);
-    }
-    return length;
-}
-
-
-void udp_send(int fd, uint8_t * buf, int size)
-{
-    struct sockaddr_in serveraddr;
-    memset( &serveraddr, 0, sizeof(serveraddr) );
-    serveraddr.sin_family = AF_INET;
-    serveraddr.sin_port = htons( 7112 );
-    serveraddr.sin_addr.s_addr = htonl( 0x7f000001 ); // (127.0.0.1)
-
-    if (sendto( fd, buf, size, 0, (struct sockaddr *)&serveraddr, sizeof(serveraddr)) < 0 ) {
-        perror( "sendto failed" );
-        exit(1);
-    }
-}
-
-static int fd = 0;
-void ccid_init()
-{
-    fd = udp_server();
-}
-
-uint32_t ccid_recv(uint8_t * msg)
-{
-    int l;
-    l = udp_recv(fd, msg, 1024);
-    return l;
+uint8_t *hwflash(size_t *size) {
+#ifdef SPIFFS_MODE
+	*size = solo_config.fssize;
+	return fsbuf;
+#else
+	*size = 0;
+	return nullptr;
+#endif
 }
 
-void ccid_send(uint8_t * msg, uint32_t sz)
-{
-    udp_send(fd, msg, sz);
+int spiffs_save() {
+	return iwritefile(solo_config.fsfile, fsbuf, solo_config.fssize);
 }
 
-void make_work_directory(char* dir) {
-	if (access(dir, F_OK) != 0) {
-		mkdir(dir, 0777);
-	}
-}
 
 bool ifileexist(char* name) {
-	char fname[100] = {0};
-	char dir[] = "./data/";
-	make_work_directory(dir);
-
-	strcpy(fname, dir);
-	strcat(fname, name);
+	char fname[CONFIG_PATH_SIZE * 2] = {0};
+	config_data_path(fname, sizeof(fname), name);
 
 	// check if it exist and have read permission
 	if (access(fname, R_OK) != 0)
@@ -237,6 +151,7 @@ bool sfileexist(char* name) {
 }
 
 bool fileexist(char* name) {
+	std::lock_guard<std::mutex> lock(fsmutex);
 #ifdef SPIFFS_MODE
 	return sfileexist(name);
 #else
@@ -246,12 +161,8 @@ bool fileexist(char* name) {
 
 int ireadfile(char* name, uint8_t * buf, size_t max_size, size_t *size) {
 
-	char fname[100] = {0};
-	char dir[] = "./data/";
-	make_work_directory(dir);
-
-	strcpy(fname, dir);
-	strcat(fname, name);
+	char fname[CONFIG_PATH_SIZE * 2] = {0};
+	config_data_path(fname, sizeof(fname), name);
 
 	// check if it exist and have read permission
 	if (access(fname, R_OK) != 0)
@@ -285,6 +196,7 @@ int sreadfile(char* name, uint8_t * buf, size_t max_size, size_t *size) {
 }
 
 bool readfile(char* name, uint8_t * buf, size_t max_size, size_t *size) {
+	std::lock_guard<std::mutex> lock(fsmutex);
 #ifdef SPIFFS_MODE
 	return sreadfile(name, buf, max_size, size);
 #else
@@ -293,12 +205,8 @@ bool readfile(char* name, uint8_t * buf, size_t max_size, size_t *size) {
 }
 
 int iwritefile(char* name, uint8_t * buf, size_t size) {
-	char fname[100] = {0};
-	char dir[] = "./data/";
-	make_work_directory(dir);
-
-	strcpy(fname, dir);
-	strcat(fname, name);
+	char fname[CONFIG_PATH_SIZE * 2] = {0};
+	config_data_path(fname, sizeof(fname), name);
 
 	FILE *f  = fopen(fname, "w");
 	if (f <= 0)
@@ -331,6 +239,7 @@ int swritefile(char* name, uint8_t * buf, size_t size) {
 }
 
 int writefile(char* name, uint8_t * buf, size_t size) {
+	std::lock_guard<std::mutex> lock(fsmutex);
 #ifdef SPIFFS_MODE
 	return swritefile(name, buf, size);
 #else
@@ -339,17 +248,14 @@ int writefile(char* name, uint8_t * buf, size_t size) {
 }
 
 int ideletefile(char* name) {
-	char fname[100] = {0};
-	char dir[] = "./data/";
-	make_work_directory(dir);
-
-	strcpy(fname, dir);
-	strcat(fname, name);
+	char fname[CONFIG_PATH_SIZE * 2] = {0};
+	config_data_path(fname, sizeof(fname), name);
 
 	remove(fname);
 	return 0;
 }
 int deletefile(char* name) {
+	std::lock_guard<std::mutex> lock(fsmutex);
 #ifdef SPIFFS_MODE
 	return SPIFFS_remove(&fs, name);
 #else
@@ -358,27 +264,22 @@ int deletefile(char* name) {
 }
 
 int ideletefiles(char* name) {
-	char fname[100] = {0};
-	char dir[] = "./data/";
-	make_work_directory(dir);
+	char fname[CONFIG_PATH_SIZE * 2] = {0};
+	config_data_path(fname, sizeof(fname), "");
 
-    DIR *dirp=opendir(dir);
+    DIR *dirp=opendir(solo_config.datadir);
     struct dirent entry;
     struct dirent *dp=&entry;
     while((dp = readdir(dirp)))
     {
 	    if((fnmatch(name, dp->d_name,0)) == 0)
 	    {
- 		    strcpy(fname, dir);
-		    strcat(fname, dp->d_name);
+		    config_data_path(fname, sizeof(fname), dp->d_name);
 		    remove(fname);
 	    }
     }
     closedir(dirp);
 
-    strcpy(fname, dir);
-    strcat(fname, name);
-
     return 0;
 }
 
@@ -404,6 +305,7 @@ int sdeletefiles(char* name) {
 	spiffs_DIR d;
 	struct spiffs_dirent e;
 	struct spiffs_dirent *pe = &e;
+	spiffs_file fd;
 	int res;
 
 	sprintfs();
@@ -424,6 +326,7 @@ int sdeletefiles(char* name) {
 }
 
 int deletefiles(char* name) {
+	std::lock_guard<std::mutex> lock(fsmutex);
 #ifdef SPIFFS_MODE
 	return sdeletefiles(name);
 #else
@@ -0,0 +1,191 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+/* pcsc-lite IFD handler. Talks to ./main over the apdusock Unix socket. */
+
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <ifdhandler.h>
+
+#include "apdusock.h"
+
+#define IFDSOLO_MAX_READERS 16
+#define IFDSOLO_READER(lun) (((lun) >> 16) % IFDSOLO_MAX_READERS)
+
+typedef struct {
+    int fd;
+    char path[108];
+    uint8_t atr[MAX_ATR_SIZE];
+    size_t atrlen;
+} IFDSOLO_READER_STATE;
+
+static IFDSOLO_READER_STATE readers[IFDSOLO_MAX_READERS];
+static uint8_t rxbuf[APDUSOCK_MAX_DATA];
+
+static int ifdsolo_connect(IFDSOLO_READER_STATE *rd) {
+    struct sockaddr_un addr;
+
+    if (rd->fd >= 0)
+        close(rd->fd);
+    rd->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (rd->fd < 0)
+        return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, rd->path, sizeof(addr.sun_path) - 1);
+    if (connect(rd->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(rd->fd);
+        rd->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+// one request/reply. reconnects once if ./main was restarted.
+static int ifdsolo_exchange(IFDSOLO_READER_STATE *rd, uint8_t type, const uint8_t *data, size_t len, size_t *rxlen) {
+    uint8_t rxtype;
+
+    for (int i = 0; i < 2; i++) {
+        if (rd->fd < 0 && ifdsolo_connect(rd))
+            return -1;
+        if (apdusock_send_frame(rd->fd, type, data, len) == 0 &&
+            apdusock_recv_frame(rd->fd, &rxtype, rxbuf, rxlen) == 0)
+            return (rxtype == type) ? 0 : -1;
+
+        close(rd->fd);
+        rd->fd = -1;
+    }
+    return -1;
+}
+
+extern "C" {
+
+RESPONSECODE IFDHCreateChannelByName(DWORD Lun, LPSTR DeviceName) {
+    IFDSOLO_READER_STATE *rd = &readers[IFDSOLO_READER(Lun)];
+
+    memset(rd, 0, sizeof(*rd));
+    rd->fd = -1;
+    strncpy(rd->path, (DeviceName && DeviceName[0]) ? DeviceName : APDUSOCK_PATH, sizeof(rd->path) - 1);
+
+    return ifdsolo_connect(rd) ? IFD_COMMUNICATION_ERROR : IFD_SUCCESS;
+}
+
+RESPONSECODE IFDHCreateChannel(DWORD Lun, DWORD Channel) {
+    return IFDHCreateChannelByName(Lun, nullptr);
+}
+
+RESPONSECODE IFDHCloseChannel(DWORD Lun) {
+    IFDSOLO_READER_STATE *rd = &readers[IFDSOLO_READER(Lun)];
+
+    if (rd->fd >= 0)
+        close(rd->fd);
+    rd->fd = -1;
+    rd->atrlen = 0;
+    return IFD_SUCCESS;
+}
+
+RESPONSECODE IFDHGetCapabilities(DWORD Lun, DWORD Tag, PDWORD Length, PUCHAR Value) {
+    IFDSOLO_READER_STATE *rd = &readers[IFDSOLO_READER(Lun)];
+
+    switch (Tag) {
+    case TAG_IFD_ATR:
+        if (*Length < rd->atrlen)
+            return IFD_ERROR_INSUFFICIENT_BUFFER;
+        memcpy(Value, rd->atr, rd->atrlen);
+        *Length = rd->atrlen;
+        return IFD_SUCCESS;
+    case TAG_IFD_SLOTS_NUMBER:
+    case TAG_IFD_SLOT_THREAD_SAFE:
+        *Length = 1;
+        *Value = 1;
+        return IFD_SUCCESS;
+    case TAG_IFD_SIMULTANEOUS_ACCESS:
+        *Length = 1;
+        *Value = IFDSOLO_MAX_READERS;
+        return IFD_SUCCESS;
+    case TAG_IFD_THREAD_SAFE:
+        *Length = 1;
+        *Value = 0;
+        return IFD_SUCCESS;
+    default:
+        return IFD_ERROR_TAG;
+    }
+}
+
+RESPONSECODE IFDHSetCapabilities(DWORD Lun, DWORD Tag, DWORD Length, PUCHAR Value) {
+    return IFD_NOT_SUPPORTED;
+}
+
+RESPONSECODE IFDHSetProtocolParameters(DWORD Lun, DWORD Protocol, UCHAR Flags, UCHAR PTS1, UCHAR PTS2, UCHAR PTS3) {
+    return (Protocol == SCARD_PROTOCOL_T1) ? IFD_SUCCESS : IFD_PROTOCOL_NOT_SUPPORTED;
+}
+
+RESPONSECODE IFDHPowerICC(DWORD Lun, DWORD Action, PUCHAR Atr, PDWORD AtrLength) {
+    IFDSOLO_READER_STATE *rd = &readers[IFDSOLO_READER(Lun)];
+    size_t len = 0;
+
+    switch (Action) {
+    case IFD_POWER_DOWN:
+        rd->atrlen = 0;
+        *AtrLength = 0;
+        return ifdsolo_exchange(rd, APDUSOCK_POWEROFF, nullptr, 0, &len) ? IFD_COMMUNICATION_ERROR : IFD_SUCCESS;
+    case IFD_POWER_UP:
+    case IFD_RESET:
+        if (ifdsolo_exchange(rd, APDUSOCK_POWERON, nullptr, 0, &len) || len > MAX_ATR_SIZE)
+            return IFD_COMMUNICATION_ERROR;
+        memcpy(rd->atr, rxbuf, len);
+        rd->atrlen = len;
+        memcpy(Atr, rxbuf, len);
+        *AtrLength = len;
+        return IFD_SUCCESS;
+    default:
+        return IFD_NOT_SUPPORTED;
+    }
+}
+
+RESPONSECODE IFDHTransmitToICC(DWORD Lun, SCARD_IO_HEADER SendPci, PUCHAR TxBuffer, DWORD TxLength,
+                               PUCHAR RxBuffer, PDWORD RxLength, PSCARD_IO_HEADER RecvPci) {
+    IFDSOLO_READER_STATE *rd = &readers[IFDSOLO_READER(Lun)];
+    size_t len = 0;
+
+    if (ifdsolo_exchange(rd, APDUSOCK_APDU, TxBuffer, TxLength, &len)) {
+        *RxLength = 0;
+        return IFD_COMMUNICATION_ERROR;
+    }
+    if (len > *RxLength) {
+        *RxLength = 0;
+        return IFD_ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    memcpy(RxBuffer, rxbuf, len);
+    *RxLength = len;
+    if (RecvPci)
+        RecvPci->Protocol = SCARD_PROTOCOL_T1;
+    return IFD_SUCCESS;
+}
+
+RESPONSECODE IFDHControl(DWORD Lun, DWORD dwControlCode, PUCHAR TxBuffer, DWORD TxLength,
+                         PUCHAR RxBuffer, DWORD RxLength, LPDWORD pdwBytesReturned) {
+    if (pdwBytesReturned)
+        *pdwBytesReturned = 0;
+    return IFD_ERROR_NOT_SUPPORTED;
+}
+
+RESPONSECODE IFDHICCPresence(DWORD Lun) {
+    IFDSOLO_READER_STATE *rd = &readers[IFDSOLO_READER(Lun)];
+
+    if (rd->fd < 0 && ifdsolo_connect(rd))
+        return IFD_ICC_NOT_PRESENT;
+    return IFD_ICC_PRESENT;
+}
+
+}
@@ -0,0 +1,99 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shmring.h"
+
+static_assert(SHMRING_MAX_FRAME >= CCID_RESPONSE_BUFFER_SIZE, "responses are built in the ring");
+
+// another running card process has the rings
+static bool shmapdu_in_use(const char *name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    
+    SHMAPDU_AREA *area = (SHMAPDU_AREA *)mmap(nullptr, sizeof(SHMAPDU_AREA), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (area == MAP_FAILED)
+        return false;
+    
+    pid_t pid = area->pid.load(std::memory_order_acquire);
+    bool res = area->magic.load(std::memory_order_acquire) == SHMAPDU_MAGIC && pid != 0 && pid != getpid() &&
+            (kill(pid, 0) == 0 || errno == EPERM);
+    munmap(area, sizeof(SHMAPDU_AREA));
+    return res;
+}
+
+// APDU in the req ring -> response APDU in the res ring. No power on/off, card 0 only.
+int shmapdu_start(const char *name, ex_cb cb) {
+    // only a stale object of a finished process is removed
+    if (shmapdu_in_use(name)) {
+        printf("shmapdu: %s is used by another process. set --shm-name\n", name);
+        return 1;
+    }
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        printf("shmapdu shm_open error : %s \n", strerror(errno));
+        return 1;
+    }
+
+    if (ftruncate(fd, sizeof(SHMAPDU_AREA)) < 0) {
+        printf("shmapdu ftruncate error : %s \n", strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return 1;
+    }
+
+    SHMAPDU_AREA *area = (SHMAPDU_AREA *)mmap(nullptr, sizeof(SHMAPDU_AREA), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (area == MAP_FAILED) {
+        printf("shmapdu mmap error : %s \n", strerror(errno));
+        shm_unlink(name);
+        return 1;
+    }
+
+    // new shm object is zero filled, so the rings are empty
+    area->pid.store(getpid(), std::memory_order_relaxed);
+    area->magic.store(SHMAPDU_MAGIC, std::memory_order_release);
+    printf("shmapdu listening on %s\n", name);
+
+    while (true) {
+        if (shmring_wait(&area->req, -1))
+            continue;
+
+        size_t len;
+        uint8_t *apdu;
+        while ((apdu = shmring_front(&area->req, &len)) != nullptr) {
+            // client does not read the responses. wait for it.
+            uint8_t *res;
+            while ((res = shmring_reserve(&area->res, SHMRING_MAX_FRAME)) == nullptr)
+                sched_yield();
+
+            size_t reslen = 0;
+            if (len <= SHMRING_MAX_FRAME)
+                cb(0, apdu, len, res, &reslen);
+            shmring_commit(&area->res, res, reslen);
+            shmring_pop(&area->req, len);
+        }
+    }
+
+    munmap(area, sizeof(SHMAPDU_AREA));
+    shm_unlink(name);
+    return 0;
+}
@@ -0,0 +1,185 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+
+#ifndef SHMRING_H_
+#define SHMRING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "ccid.h"
+
+/* Single producer single consumer ring of frames in shared memory.
+   Frame: length(4) + data, aligned to 4 bytes. The frame never wraps: when it does not fit
+   to the end of the ring, SHMRING_WRAP length is written and the frame starts from offset 0.
+   head/tail are free running byte counters, the futex word is the tail. */
+#define SHMRING_SIZE            (256 * 1024)    // power of 2
+#define SHMRING_MAX_FRAME       65544
+#define SHMRING_WRAP            0xffffffffU
+#define SHMRING_SPIN            1000            // polls before sleeping on the futex
+
+#define SHMAPDU_NAME            "/solo-openpgp-shm"
+#define SHMAPDU_MAGIC           0x534f4c4fU     // "SOLO"
+
+static_assert((SHMRING_SIZE & (SHMRING_SIZE - 1)) == 0, "ring size must be a power of 2");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "ring needs lock free 32 bit atomics");
+
+typedef struct _SHMRING
+{
+    alignas(64) std::atomic<uint32_t> tail;     // written by the producer
+    std::atomic<uint32_t> waiting;              // consumer sleeps on tail
+    alignas(64) std::atomic<uint32_t> head;     // written by the consumer
+    alignas(64) uint8_t data[SHMRING_SIZE];
+}SHMRING;
+
+// card process consumes req and produces res, the client vice versa
+typedef struct _SHMAPDU_AREA
+{
+    std::atomic<uint32_t> magic;                // set by the card process when the rings are ready
+    std::atomic<uint32_t> pid;                  // of the card process
+    SHMRING req;
+    SHMRING res;
+}SHMAPDU_AREA;
+
+static inline uint32_t shmring_align(size_t len) {
+    return (4 + len + 3) & ~3U;
+}
+
+static inline long shmring_futex(std::atomic<uint32_t> *addr, int op, uint32_t val, const struct timespec *timeout) {
+    return syscall(SYS_futex, (uint32_t *)addr, op, val, timeout, nullptr, 0);
+}
+
+// producer. space for a frame of maxlen bytes or nullptr when the ring is full.
+static inline uint8_t *shmring_reserve(SHMRING *ring, size_t maxlen) {
+    if (maxlen > SHMRING_MAX_FRAME)
+        return nullptr;
+
+    uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint32_t head = ring->head.load(std::memory_order_acquire);
+    uint32_t offset = tail & (SHMRING_SIZE - 1);
+    uint32_t need = shmring_align(maxlen);
+    if (offset + need > SHMRING_SIZE)
+        need += SHMRING_SIZE - offset;
+    if (SHMRING_SIZE - (tail - head) < need)
+        return nullptr;
+
+    if (offset + shmring_align(maxlen) > SHMRING_SIZE) {
+        uint32_t wrap = SHMRING_WRAP;
+        memcpy(&ring->data[offset], &wrap, 4);
+        offset = 0;
+    }
+    return &ring->data[offset + 4];
+}
+
+// producer. publish the frame from shmring_reserve with the real length.
+static inline void shmring_commit(SHMRING *ring, uint8_t *frame, size_t len) {
+    uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint32_t offset = tail & (SHMRING_SIZE - 1);
+    uint32_t start = (uint32_t)(frame - ring->data) - 4;
+
+    uint32_t len32 = len;
+    memcpy(&ring->data[start], &len32, 4);
+
+    if (start != offset)
+        tail += SHMRING_SIZE - offset;
+    ring->tail.store(tail + shmring_align(len), std::memory_order_release);
+
+    // pairs with the consumer: waiting = 1, then reads tail
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ring->waiting.load(std::memory_order_seq_cst))
+        shmring_futex(&ring->tail, FUTEX_WAKE, 1, nullptr);
+}
+
+static inline int shmring_push(SHMRING *ring, const uint8_t *data, size_t len) {
+    uint8_t *frame = shmring_reserve(ring, len);
+    if (frame == nullptr)
+        return -1;
+    memcpy(frame, data, len);
+    shmring_commit(ring, frame, len);
+    return 0;
+}
+
+// consumer. oldest frame stays in the ring until shmring_pop.
+static inline uint8_t *shmring_front(SHMRING *ring, size_t *len) {
+    uint32_t head = ring->head.load(std::memory_order_relaxed);
+    uint32_t tail = ring->tail.load(std::memory_order_acquire);
+    if (head == tail)
+        return nullptr;
+
+    uint32_t offset = head & (SHMRING_SIZE - 1);
+    uint32_t len32;
+    memcpy(&len32, &ring->data[offset], 4);
+    if (len32 == SHMRING_WRAP) {
+        head += SHMRING_SIZE - offset;
+        ring->head.store(head, std::memory_order_release);
+        offset = 0;
+        memcpy(&len32, &ring->data[offset], 4);
+    }
+
+    *len = len32;
+    return &ring->data[offset + 4];
+}
+
+static inline void shmring_pop(SHMRING *ring, size_t len) {
+    uint32_t head = ring->head.load(std::memory_order_relaxed);
+    ring->head.store(head + shmring_align(len), std::memory_order_release);
+}
+
+// consumer. spin a bit, then sleep on the futex until a frame comes. -1 - timeout.
+static inline int shmring_wait(SHMRING *ring, int timeout_ms) {
+    uint32_t head = ring->head.load(std::memory_order_relaxed);
+    for (int i = 0; i < SHMRING_SPIN; i++)
+        if (ring->tail.load(std::memory_order_acquire) != head)
+            return 0;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    // the wake may belong to the previous frame, so sleep again until tail moves
+    while (true) {
+        struct timespec ts = {0, 0}, now;
+        if (timeout_ms >= 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            ts.tv_sec = deadline.tv_sec - now.tv_sec;
+            ts.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+            if (ts.tv_nsec < 0) {
+                ts.tv_sec--;
+                ts.tv_nsec += 1000000000L;
+            }
+            if (ts.tv_sec < 0)
+                return -1;
+        }
+
+        ring->waiting.store(1, std::memory_order_seq_cst);
+        uint32_t tail = ring->tail.load(std::memory_order_seq_cst);
+        if (tail == head)
+            shmring_futex(&ring->tail, FUTEX_WAIT, tail, (timeout_ms < 0) ? nullptr : &ts);
+        ring->waiting.store(0, std::memory_order_relaxed);
+
+        if (ring->tail.load(std::memory_order_acquire) != head)
+            return 0;
+    }
+}
+
+extern int shmapdu_start(const char *name, ex_cb cb);
+
+#endif /* SHMRING_H_ */
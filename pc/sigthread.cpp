@@ -0,0 +1,34 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include <thread>
+
+#include "sigthread.h"
+
+int sigthread_start(int signo, sigthread_cb cb) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, signo);
+    if (pthread_sigmask(SIG_BLOCK, &set, nullptr)) {
+        printf("can't block signal %d\n", signo);
+        return 1;
+    }
+
+    std::thread t([set, cb] {
+        while (true) {
+            int sig;
+            if (sigwait(&set, &sig) == 0)
+                cb(sig);
+        }
+    });
+    t.detach();
+    return 0;
+}
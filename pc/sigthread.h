@@ -0,0 +1,22 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+
+#ifndef SIGTHREAD_H_
+#define SIGTHREAD_H_
+
+#include <signal.h>
+
+typedef void (*sigthread_cb)(int signo);
+
+/* cb runs in a thread that waits for the signal, so it may use stdio and locks.
+   Call before other threads start: the signal is blocked in the threads that inherit the mask. */
+extern int sigthread_start(int signo, sigthread_cb cb);
+
+#endif /* SIGTHREAD_H_ */
@@ -0,0 +1,94 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <thread>
+
+#include "tracedrain.h"
+#include "sigthread.h"
+#include "trace.h"
+
+static void tracedrain_lost(FILE *f, bool text, uint32_t *lost) {
+    if (*lost == 0)
+        return;
+    if (text)
+        fprintf(f, "trace: %u records lost\n", *lost);
+    *lost = 0;
+}
+
+// all ready records. returns count.
+static size_t tracedrain_copy(FILE *f, bool text) {
+    Trace::Record rec;
+    uint32_t lost = 0;
+    size_t count = 0;
+    char line[256];
+
+    while (Trace::Read(rec, lost)) {
+        tracedrain_lost(f, text, &lost);
+        if (text) {
+            Trace::Format(rec, line, sizeof(line));
+            fprintf(f, "%s\n", line);
+        } else {
+            fwrite(&rec, sizeof(rec), 1, f);
+        }
+        count++;
+    }
+    // binary file has record numbers, gaps are visible without a mark
+    tracedrain_lost(f, text, &lost);
+    return count;
+}
+
+int tracedrain_start(const char *path) {
+    bool text = strcmp(path, TRACEDRAIN_STDOUT) == 0;
+    FILE *f = text ? stdout : fopen(path, "wb");
+    if (f == nullptr) {
+        printf("trace: can't open %s\n", path);
+        return 1;
+    }
+
+    std::thread t([f, text] {
+        while (true) {
+            if (tracedrain_copy(f, text))
+                fflush(f);
+            else
+                usleep(TRACEDRAIN_INTERVAL_MS * 1000);
+        }
+    });
+    t.detach();
+    return 0;
+}
+
+int tracedrain_dump(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (f == nullptr) {
+        printf("trace: can't open %s\n", path);
+        return 1;
+    }
+    size_t count = tracedrain_copy(f, false);
+    fclose(f);
+    printf("trace: %lu records saved to %s\n", count, path);
+    return 0;
+}
+
+static char dumppath[256];
+
+static void tracedrain_signal(int signo) {
+    tracedrain_dump(dumppath);
+}
+
+int tracedrain_dump_on_signal(int signo, const char *path) {
+    if (strlen(path) >= sizeof(dumppath)) {
+        printf("trace: path too long: %s\n", path);
+        return 1;
+    }
+    strcpy(dumppath, path);
+    return sigthread_start(signo, tracedrain_signal);
+}
@@ -0,0 +1,30 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+
+#ifndef TRACEDRAIN_H_
+#define TRACEDRAIN_H_
+
+#include <signal.h>
+
+/* Consumer of the trace ring (src/trace.h). Only one of them may run.
+   Binary file: Trace::Record sequence, tools/tracedump prints it. */
+#define TRACEDRAIN_STDOUT       "-"             // text lines instead of a binary file
+#define TRACEDRAIN_INTERVAL_MS  20              // poll of the ring when it is empty
+#define TRACEDRAIN_DUMP_FILE    "trace.bin"     // in data-dir
+#define TRACEDRAIN_DUMP_SIGNAL  SIGUSR2
+
+// background thread moves records from the ring to the file or stdout
+extern int tracedrain_start(const char *path);
+// records that are in the ring now to the binary file
+extern int tracedrain_dump(const char *path);
+// dump to the file on signal. call before other threads start: the signal is blocked in all of them.
+extern int tracedrain_dump_on_signal(int signo, const char *path);
+
+#endif /* TRACEDRAIN_H_ */
@@ -0,0 +1,120 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "ccid.h"
+#include "usbip.h"
+
+/* CCID messages in UDP datagrams (card_reader.py). Reply goes to the sender. */
+#define UDPCCID_BATCH   8       // datagrams per recvmmsg/sendmmsg
+
+static uint8_t rxbuf[UDPCCID_BATCH][CCID_MAX_MESSAGE_LENGTH];
+// abData of a row is the response buffer of ex_cb, as in CCID_CONNECTION::bufferout
+static uint8_t txbuf[UDPCCID_BATCH][CCID_HEADER_SIZE + CCID_RESPONSE_BUFFER_SIZE];
+
+static_assert(sizeof(txbuf[0]) >= CCID_HEADER_SIZE + CCID_RESPONSE_BUFFER_SIZE, "responses are built in txbuf");
+
+int udp_ccid_start(int port, ex_cb cb) {
+    struct sockaddr_in serveraddr;
+    struct sockaddr_in addr[UDPCCID_BATCH];
+    struct iovec rxiov[UDPCCID_BATCH], txiov[UDPCCID_BATCH];
+    struct mmsghdr rxmsg[UDPCCID_BATCH], txmsg[UDPCCID_BATCH];
+    struct epoll_event ev;
+    int fd, epollfd, n, i;
+
+    ccid_set_exchange_callback(cb);
+
+    if ((fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)) < 0) {
+        perror("socket failed");
+        return 1;
+    }
+
+    memset(&serveraddr, 0, sizeof(serveraddr));
+    serveraddr.sin_family = AF_INET;
+    serveraddr.sin_port = htons(port);
+    serveraddr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (bind(fd, (struct sockaddr *)&serveraddr, sizeof(serveraddr)) < 0) {
+        perror("bind failed");
+        close(fd);
+        return 1;
+    }
+
+    if ((epollfd = epoll_create1(0)) < 0) {
+        perror("epoll failed");
+        close(fd);
+        return 1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev);
+
+    printf("udp ccid started on port %d....\n", port);
+    while (true) {
+        // sleeps until a datagram comes
+        if (epoll_wait(epollfd, &ev, 1, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait failed");
+            break;
+        }
+
+        while (true) {
+            memset(rxmsg, 0, sizeof(rxmsg));
+            for (i = 0; i < UDPCCID_BATCH; i++) {
+                rxiov[i].iov_base = rxbuf[i];
+                rxiov[i].iov_len = sizeof(rxbuf[i]);
+                rxmsg[i].msg_hdr.msg_iov = &rxiov[i];
+                rxmsg[i].msg_hdr.msg_iovlen = 1;
+                rxmsg[i].msg_hdr.msg_name = &addr[i];
+                rxmsg[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+            }
+
+            n = recvmmsg(fd, rxmsg, UDPCCID_BATCH, 0, nullptr);
+            if (n <= 0) {
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                    perror("recvmmsg failed");
+                break;
+            }
+
+            int cnt = 0;
+            for (i = 0; i < n; i++) {
+                size_t len = 0;
+                if (!ProcessCCIDTransfer(rxbuf[i], rxmsg[i].msg_len, txbuf[cnt], &len)) {
+                    printf("udp ccid: wrong message. length %u\n", rxmsg[i].msg_len);
+                    continue;
+                }
+
+                memset(&txmsg[cnt], 0, sizeof(txmsg[cnt]));
+                txiov[cnt].iov_base = txbuf[cnt];
+                txiov[cnt].iov_len = len;
+                txmsg[cnt].msg_hdr.msg_iov = &txiov[cnt];
+                txmsg[cnt].msg_hdr.msg_iovlen = 1;
+                txmsg[cnt].msg_hdr.msg_name = &addr[i];
+                txmsg[cnt].msg_hdr.msg_namelen = rxmsg[i].msg_hdr.msg_namelen;
+                cnt++;
+            }
+
+            if (cnt && sendmmsg(fd, txmsg, cnt, 0) < 0)
+                perror("sendmmsg failed");
+
+            if (n < UDPCCID_BATCH)
+                break;
+        }
+    }
+
+    close(epollfd);
+    close(fd);
+    return 0;
+}
@@ -59,21 +59,42 @@ WORD wVersionRequested = 2;
 WSADATA wsaData;
 #endif
 
-void handle_device_list(const USB_DEVICE_DESCRIPTOR *dev_dsc, OP_REP_DEVLIST *list)
+static USBIP_CONNECTION *busowner[USBIP_BUSID_COUNT];
+static int usbip_bus = 1;
+
+void usbip_busid_name(int busid, char *name)
+{
+  memset(name,0,32);
+  snprintf(name,32,"%d-%d",usbip_bus,busid+1);
+}
+
+int usbip_find_busid(const char *name)
+{
+  char bname[32];
+  int i;
+  for(i=0;i<USBIP_BUSID_COUNT;i++)
+  {
+    usbip_busid_name(i,bname);
+    if(strncmp(bname,name,32) == 0)
+      return i;
+  }
+  return -1;
+}
+
+void handle_device_list(const USB_DEVICE_DESCRIPTOR *dev_dsc, int busid, OP_REP_DEVLIST *list)
 {
   CONFIG_GEN * conf= (CONFIG_GEN *)configuration;   
   int i;
   list->header.version=htons(273);
   list->header.command=htons(5);
   list->header.status=0;
-  list->header.nExportedDevice=htonl(1);
+  list->header.nExportedDevice=htonl(USBIP_BUSID_COUNT);
+  usbip_busid_name(busid,list->device.busID);
   memset(list->device.usbPath,0,256);
-  strcpy(list->device.usbPath,"/sys/devices/pci0000:00/0000:00:01.2/usb1/1-1");
-  memset(list->device.busID,0,32);
-  strcpy(list->device.busID,"1-1");
-  list->device.busnum=htonl(1);
-  list->device.devnum=htonl(2);
-  list->device.speed=htonl(2);
+  snprintf(list->device.usbPath,256,"/sys/devices/pci0000:00/0000:00:01.2/usb%d/%s",usbip_bus,list->device.busID);
+  list->device.busnum=htonl(usbip_bus);
+  list->device.devnum=htonl(busid+2);
+  list->device.speed=htonl(USBIP_SPEED_HIGH);
   list->device.idVendor=htons(dev_dsc->idVendor);
   list->device.idProduct=htons(dev_dsc->idProduct);
   list->device.bcdDevice=htons(dev_dsc->bcdDevice);
@@ -93,20 +114,19 @@ void handle_device_list(const USB_DEVICE_DESCRIPTOR *dev_dsc, OP_REP_DEVLIST *li
   }
 };
 
-void handle_attach(const USB_DEVICE_DESCRIPTOR *dev_dsc, OP_REP_IMPORT *rep)
+void handle_attach(const USB_DEVICE_DESCRIPTOR *dev_dsc, int busid, OP_REP_IMPORT *rep)
 {
   CONFIG_GEN * conf= (CONFIG_GEN *)configuration; 
     
   rep->version=htons(273);
   rep->command=htons(3);
   rep->status=0;
+  usbip_busid_name(busid,rep->busID);
   memset(rep->usbPath,0,256);
-  strcpy(rep->usbPath,"/sys/devices/pci0000:00/0000:00:01.2/usb1/1-1");
-  memset(rep->busID,0,32);
-  strcpy(rep->busID,"1-1");
-  rep->busnum=htonl(1);
-  rep->devnum=htonl(2);
-  rep->speed=htonl(2);
+  snprintf(rep->usbPath,256,"/sys/devices/pci0000:00/0000:00:01.2/usb%d/%s",usbip_bus,rep->busID);
+  rep->busnum=htonl(usbip_bus);
+  rep->devnum=htonl(busid+2);
+  rep->speed=htonl(USBIP_SPEED_HIGH);
   rep->idVendor=dev_dsc->idVendor;
   rep->idProduct=dev_dsc->idProduct;
   rep->bcdDevice=dev_dsc->bcdDevice;
@@ -147,8 +167,71 @@ void unpack(int * data, int size)
 }  
 
 
-void send_usb_req(int sockfd, USBIP_RET_SUBMIT * usb_req, char * data, unsigned int size, unsigned int status)
+// write the whole iovec or queue what is left for EPOLLOUT. replies keep their order.
+int usbip_send(USBIP_CONNECTION *conn, const struct iovec *iov, int iovcnt)
 {
+        ssize_t total = 0, nb = 0;
+        int i;
+
+        for(i=0;i<iovcnt;i++)
+          total += iov[i].iov_len;
+
+        if(conn->error)
+          return -1;
+
+        if(conn->wlen == 0)
+        {
+          struct msghdr msg;
+          memset(&msg, 0, sizeof(msg));
+          msg.msg_iov = (struct iovec *)iov;
+          msg.msg_iovlen = iovcnt;
+          nb = sendmsg(conn->sockfd, &msg, MSG_NOSIGNAL);
+          if(nb < 0)
+          {
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+              printf ("send error : %s \n", strerror (errno));
+              conn->error = 1;
+              return -1;
+            }
+            nb = 0;
+          }
+          if(nb == total)
+            return 0;
+        }
+
+        if(conn->wlen + total - nb > USBIP_BUFFER_SIZE)
+        {
+          printf ("send error : write buffer overflow\n");
+          conn->error = 1;
+          return -1;
+        }
+
+        // skip the part already sent and buffer the rest
+        for(i=0;i<iovcnt;i++)
+        {
+          ssize_t len = iov[i].iov_len;
+          if(nb >= len)
+          {
+            nb -= len;
+            continue;
+          }
+          memcpy(conn->wbuf + conn->wlen, (char *)iov[i].iov_base + nb, len - nb);
+          conn->wlen += len - nb;
+          nb = 0;
+        }
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+        ev.data.ptr = conn;
+        epoll_ctl(conn->epollfd, EPOLL_CTL_MOD, conn->sockfd, &ev);
+        return 0;
+}
+
+void send_usb_req(USBIP_CONNECTION *conn, USBIP_RET_SUBMIT * usb_req, char * data, unsigned int size, unsigned int status)
+{
+        struct iovec iov[2];
+
         usb_req->command=0x3;
         usb_req->status=status;
         usb_req->actual_length=size;
@@ -161,24 +244,96 @@ void send_usb_req(int sockfd, USBIP_RET_SUBMIT * usb_req, char * data, unsigned
         usb_req->ep=0x0;    
     
         pack((int *)usb_req, sizeof(USBIP_RET_SUBMIT));
- 
-        if (send (sockfd, (char *)usb_req, sizeof(USBIP_RET_SUBMIT), 0) != sizeof(USBIP_RET_SUBMIT))
+
+        // header and payload in one syscall
+        iov[0].iov_base = usb_req;
+        iov[0].iov_len = sizeof(USBIP_RET_SUBMIT);
+        iov[1].iov_base = data;
+        iov[1].iov_len = size;
+        usbip_send(conn, iov, size > 0 ? 2 : 1);
+} 
+            
+// keep an IN URB until the device has data for it. returns -1 if the queue is full.
+int usbip_urb_park(USBIP_CONNECTION *conn, USBIP_RET_SUBMIT *usb_req, int length)
+{
+        if(conn->urbcount >= USBIP_MAX_PENDING_URB)
         {
-          printf ("send error : %s \n", strerror (errno));
-          exit(-1);
-        };
+          printf("urb queue full. seqnum %u\n", usb_req->seqnum);
+          return -1;
+        }
+
+        USBIP_URB *urb = &conn->urbs[conn->urbcount++];
+        urb->req = *usb_req;
+        urb->ep = usb_req->ep;
+        urb->length = length;
+        return 0;
+}
 
-        if(size > 0)
+void usbip_urb_remove(USBIP_CONNECTION *conn, int index)
+{
+        memmove(&conn->urbs[index], &conn->urbs[index + 1], (conn->urbcount - index - 1) * sizeof(USBIP_URB));
+        conn->urbcount--;
+}
+
+// complete the oldest URB parked on ep with up to its transfer_buffer_length bytes.
+// returns the number of bytes sent or -1 if there is no URB.
+int usbip_urb_complete(USBIP_CONNECTION *conn, int ep, char *data, unsigned int size, unsigned int status)
+{
+        int i;
+        for(i=0;i<conn->urbcount;i++)
         {
-           if (send (sockfd, data, size, 0) != size)
-           {
-             printf ("send error : %s \n", strerror (errno));
-             exit(-1);
-           };
+          if(conn->urbs[i].ep != ep)
+            continue;
+
+          USBIP_RET_SUBMIT usb_req = conn->urbs[i].req;
+          unsigned int len = size;
+          if(len > (unsigned int)conn->urbs[i].length)
+            len = conn->urbs[i].length;
+          usbip_urb_remove(conn, i);
+          send_usb_req(conn, &usb_req, data, len, status);
+          return len;
         }
-} 
-            
-int handle_get_descriptor(int sockfd, StandardDeviceRequest * control_req, USBIP_RET_SUBMIT *usb_req)
+        return -1;
+}
+
+int usbip_urb_pending(USBIP_CONNECTION *conn, int ep)
+{
+        int i, cnt = 0;
+        for(i=0;i<conn->urbcount;i++)
+          if(conn->urbs[i].ep == ep)
+            cnt++;
+        return cnt;
+}
+
+// CMD_UNLINK. -ECONNRESET if the URB was still parked, 0 if it had been completed already.
+void handle_unlink(USBIP_CONNECTION *conn, USBIP_CMD_UNLINK *cmd)
+{
+        USBIP_RET_UNLINK ret;
+        struct iovec iov;
+        int i, status = 0;
+
+        for(i=0;i<conn->urbcount;i++)
+        {
+          if(conn->urbs[i].req.seqnum == cmd->seqnum_urb)
+          {
+            usbip_urb_remove(conn, i);
+            status = -ECONNRESET;
+            break;
+          }
+        }
+        printf("Unlink URB %u %s\n", cmd->seqnum_urb, status ? "cancelled" : "not found");
+
+        memset(&ret, 0, sizeof(ret));
+        ret.command=htonl(0x04);
+        ret.seqnum=htonl(cmd->seqnum);
+        ret.status=htonl(status);
+
+        iov.iov_base = &ret;
+        iov.iov_len = sizeof(USBIP_RET_UNLINK);
+        usbip_send(conn, &iov, 1);
+}
+
+int handle_get_descriptor(USBIP_CONNECTION *conn, StandardDeviceRequest * control_req, USBIP_RET_SUBMIT *usb_req)
 {
   int handled = 0;
   printf("handle_get_descriptor %u [%u]\n",control_req->wValue1,control_req->wValue0 );
@@ -186,13 +341,16 @@ int handle_get_descriptor(int sockfd, StandardDeviceRequest * control_req, USBIP
   {
     printf("Device\n");  
     handled = 1;
-    send_usb_req(sockfd,usb_req, (char *)&dev_dsc, sizeof(USB_DEVICE_DESCRIPTOR)/*control_req->wLength*/, 0);
+    send_usb_req(conn,usb_req, (char *)&dev_dsc, sizeof(USB_DEVICE_DESCRIPTOR)/*control_req->wLength*/, 0);
    } 
    if(control_req->wValue1 == 0x2) // configuration
    {
      printf("Configuration\n");  
      handled = 1;
-     send_usb_req(sockfd,usb_req, (char *) configuration, control_req->wLength ,0);
+     unsigned int len = ((USB_CONFIGURATION_DESCRIPTOR *)configuration)->wTotalLength;
+     if(control_req->wLength < len)
+       len = control_req->wLength;
+     send_usb_req(conn,usb_req, (char *) configuration, len ,0);
    }
    if(control_req->wValue1 == 0x3) // string
    {
@@ -203,13 +361,25 @@ int handle_get_descriptor(int sockfd, StandardDeviceRequest * control_req, USBIP
         str[i]=strings[control_req->wValue0][i*2+2];
      printf("String (%s)\n",str);  
      handled = 1;
-     send_usb_req(sockfd,usb_req, (char *) strings[control_req->wValue0] ,*strings[control_req->wValue0]  ,0);
+     send_usb_req(conn,usb_req, (char *) strings[control_req->wValue0] ,*strings[control_req->wValue0]  ,0);
    }
    if(control_req->wValue1 == 0x6) // qualifier
    {
      printf("Qualifier\n");  
      handled = 1;
-     send_usb_req(sockfd,usb_req, (char *) &dev_qua , control_req->wLength ,0);
+     unsigned int len = sizeof(dev_qua);
+     if(control_req->wLength < len)
+       len = control_req->wLength;
+     send_usb_req(conn,usb_req, (char *) &dev_qua , len ,0);
+   }
+   if(control_req->wValue1 == 0x7) // other speed configuration
+   {
+     printf("Other speed configuration\n");
+     handled = 1;
+     unsigned int len = ((USB_CONFIGURATION_DESCRIPTOR *)configuration_other_speed)->wTotalLength;
+     if(control_req->wLength < len)
+       len = control_req->wLength;
+     send_usb_req(conn,usb_req, (char *) configuration_other_speed, len ,0);
    }
    if(control_req->wValue1 == 0xA) // Get interface 
    {
@@ -217,23 +387,23 @@ int handle_get_descriptor(int sockfd, StandardDeviceRequest * control_req, USBIP
      handled = 1;
      printf("interface number: %d\n", control_req->wIndex0);
      uint8_t intf[1] = {0x00};
-     send_usb_req(sockfd, usb_req, (char *) intf, 1, 0);
+     send_usb_req(conn, usb_req, (char *) intf, 1, 0);
    }  
    return handled;
 }
 
-int handle_set_configuration(int sockfd, StandardDeviceRequest * control_req, USBIP_RET_SUBMIT *usb_req)
+int handle_set_configuration(USBIP_CONNECTION *conn, StandardDeviceRequest * control_req, USBIP_RET_SUBMIT *usb_req)
 {
   int handled = 0;
   printf("handle_set_configuration %u[%u]\n",control_req->wValue1,control_req->wValue0 );
   handled = 1;
-  send_usb_req(sockfd, usb_req, nullptr, 0, 0);        
+  send_usb_req(conn, usb_req, nullptr, 0, 0);        
   return handled;
 }
 
 //http://www.usbmadesimple.co.uk/ums_4.htm
 
-void handle_usb_control(int sockfd, USBIP_RET_SUBMIT *usb_req)
+void handle_usb_control(USBIP_CONNECTION *conn, USBIP_RET_SUBMIT *usb_req, char *data)
 {
         int handled = 0;
         StandardDeviceRequest control_req;
@@ -261,14 +431,14 @@ void handle_usb_control(int sockfd, USBIP_RET_SUBMIT *usb_req)
         {
           if(control_req.bRequest == 0x06) // Get Descriptor
           {
-            handled = handle_get_descriptor(sockfd, &control_req, usb_req);
+            handled = handle_get_descriptor(conn, &control_req, usb_req);
           }
           if(control_req.bRequest == 0x00) // Get STATUS
           {
-            char data[2];
-            data[0]=0x01;
-            data[1]=0x00;
-            send_usb_req(sockfd,usb_req, data, 2 , 0);        
+            char status[2];
+            status[0]=0x01;
+            status[1]=0x00;
+            send_usb_req(conn,usb_req, status, 2 , 0);        
             handled = 1;
             printf("GET_STATUS\n");   
           }
@@ -277,7 +447,7 @@ void handle_usb_control(int sockfd, USBIP_RET_SUBMIT *usb_req)
         {
             if(control_req.bRequest == 0x09) // Set Configuration
             {
-                handled = handle_set_configuration(sockfd, &control_req, usb_req);
+                handled = handle_set_configuration(conn, &control_req, usb_req);
             }
         }  
         if(control_req.bmRequestType == 0x01)
@@ -285,46 +455,310 @@ void handle_usb_control(int sockfd, USBIP_RET_SUBMIT *usb_req)
           if(control_req.bRequest == 0x0B) //SET_INTERFACE  
           {
             printf("SET_INTERFACE\n");   
-            send_usb_req(sockfd,usb_req,nullptr,0,1);
+            send_usb_req(conn,usb_req,nullptr,0,1);
             handled=1; 
           } 
         }
         if(! handled)
-            handle_unknown_control(sockfd, &control_req, usb_req);
+            handle_unknown_control(conn, &control_req, usb_req, data);
 }
 
            
-void handle_usb_request(int sockfd, USBIP_RET_SUBMIT *ret, int bl)
+void handle_usb_request(USBIP_CONNECTION *conn, USBIP_RET_SUBMIT *ret, char *data, int bl)
 {
    if(ret->ep == 0)
    {
 #ifdef _DEBUGPRN
       printf("#control requests\n");
 #endif // _DEBUGPRN
-      handle_usb_control(sockfd, ret);
+      handle_usb_control(conn, ret, data);
    }
    else
    {
 #ifdef _DEBUGPRN
       printf("#data requests\n");
 #endif // _DEBUGPRN
-      handle_data(sockfd, ret, bl);
+      handle_data(conn, ret, data, bl);
    }
 };
 
+int usbip_send_import_error(USBIP_CONNECTION *conn, int status)
+{
+  OP_REP_IMPORT rep;
+  struct iovec iov;
+  rep.version=htons(273);
+  rep.command=htons(3);
+  rep.status=htonl(status);
+  // header only, the device part is not sent on error
+  iov.iov_base = &rep;
+  iov.iov_len = 8;
+  return usbip_send(conn, &iov, 1);
+}
+
+// length of the message at msg. 0 - header not complete yet, -1 - message can't be handled.
+int usbip_message_length(USBIP_CONNECTION *conn, char *msg, size_t avail)
+{
+  if(! conn->attached)
+  {
+    if(avail < sizeof(OP_REQ_DEVLIST))
+      return 0;
+    OP_REQ_DEVLIST *req = (OP_REQ_DEVLIST *)msg;
+    if(ntohs(req->command) == 0x8003)
+      return sizeof(OP_REQ_IMPORT);
+    return sizeof(OP_REQ_DEVLIST);
+  }
+
+  if(avail < USBIP_HEADER_SIZE)
+    return 0;
+  USBIP_CMD_SUBMIT *cmd = (USBIP_CMD_SUBMIT *)msg;
+  if(ntohl(cmd->command) != 1)
+    return USBIP_HEADER_SIZE;
+
+  unsigned int len = USBIP_HEADER_SIZE;
+  int npackets = ntohl(cmd->number_of_packets);
+  if(ntohl(cmd->direction) == 0)
+    len += ntohl(cmd->transfer_buffer_length);
+  if(npackets > 0)  // iso descriptors, 0xffffffff for non-iso
+    len += npackets * 16;
+  if(len > USBIP_BUFFER_SIZE)
+  {
+    printf("usbip message too long: %u\n", len);
+    return -1;
+  }
+  return len;
+}
+
+// one complete message from the client. returns -1 if the connection must be closed.
+int usbip_handle_request(USBIP_CONNECTION *conn, const USB_DEVICE_DESCRIPTOR *dev_dsc, char *msg, int len)
+{
+  if(! conn->attached)
+  {
+     OP_REQ_DEVLIST req;
+     memcpy(&req, msg, sizeof(OP_REQ_DEVLIST));
+#ifdef _DEBUG
+     print_recv((char *)&req, sizeof(OP_REQ_DEVLIST),"OP_REQ_DEVLIST");
+#endif
+     req.command=ntohs(req.command);
+     printf("Header Packet\n");  
+     printf("command: 0x%02X\n",req.command);
+     if(req.command == 0x8005)
+     {
+       OP_REP_DEVLIST list[USBIP_BUSID_COUNT];
+       struct iovec iov[1 + USBIP_BUSID_COUNT * 2];
+       int i, res;
+       printf("list of devices\n");
+
+       for(i=0;i<USBIP_BUSID_COUNT;i++)
+       {
+         handle_device_list(dev_dsc,i,&list[i]);
+         iov[1+i*2].iov_base = &list[i].device;
+         iov[1+i*2].iov_len = sizeof(OP_REP_DEVLIST_DEVICE);
+         iov[2+i*2].iov_base = list[i].interfaces;
+         iov[2+i*2].iov_len = sizeof(OP_REP_DEVLIST_INTERFACE)*list[i].device.bNumInterfaces;
+       }
+       iov[0].iov_base = &list[0].header;
+       iov[0].iov_len = sizeof(OP_REP_DEVLIST_HEADER);
+
+       res = usbip_send(conn, iov, 1 + USBIP_BUSID_COUNT * 2);
+       for(i=0;i<USBIP_BUSID_COUNT;i++)
+         free(list[i].interfaces);
+       if(res)
+         return -1;
+     }
+     else if(req.command == 0x8003) 
+     {
+       OP_REQ_IMPORT *imp = (OP_REQ_IMPORT *)msg;
+       char busid[32];
+       OP_REP_IMPORT rep;
+       struct iovec iov;
+       int bus;
+       printf("attach device\n");
+       memcpy(busid, imp->busID, 32);
+#ifdef _DEBUG
+       print_recv(busid, 32,"Busid");
+#endif
+       busid[31]=0;
+       bus=usbip_find_busid(busid);
+       if(bus < 0)
+       {
+         printf("attach: no device %s\n",busid);
+         return usbip_send_import_error(conn, 4);  // ST_NODEV
+       }
+       if(busowner[bus] != nullptr)
+       {
+         printf("attach: device %s busy\n",busid);
+         return usbip_send_import_error(conn, 2);  // ST_DEV_BUSY
+       }
+
+       conn->busid = bus;
+       if(handle_device_attach(conn))
+       {
+         conn->busid = -1;
+         return usbip_send_import_error(conn, 3);  // ST_DEV_ERR
+       }
+
+       handle_attach(dev_dsc,bus,&rep);
+       iov.iov_base = &rep;
+       iov.iov_len = sizeof(OP_REP_IMPORT);
+       if (usbip_send(conn, &iov, 1))
+       {
+           handle_device_detach(conn);
+           conn->busid = -1;
+           return -1;
+       };
+       busowner[bus] = conn;
+       conn->attached = 1;
+     }
+  }
+  else
+  {
+#ifdef _DEBUGPRN
+     printf("------------------------------------------------\n"); 
+     printf("handles requests\n");
+#endif // _DEBUGPRN
+     USBIP_CMD_SUBMIT cmd;
+     USBIP_RET_SUBMIT usb_req;
+     memcpy(&cmd, msg, sizeof(USBIP_CMD_SUBMIT));
+#ifdef _DEBUG
+     print_recv((char *)&cmd, sizeof(USBIP_CMD_SUBMIT),"USBIP_CMD_SUBMIT");
+#endif
+     unpack((int *)&cmd,sizeof(USBIP_CMD_SUBMIT));               
+#ifdef _DEBUGPRN
+     printf("usbip cmd %u\n",cmd.command);
+     printf("usbip seqnum %u\n",cmd.seqnum);
+     printf("usbip devid %u\n",cmd.devid);
+     printf("usbip direction %u\n",cmd.direction);
+     printf("usbip ep %u\n",cmd.ep);
+     printf("usbip flags %u\n",cmd.transfer_flags);
+     printf("usbip number of packets %u\n",cmd.number_of_packets);
+     printf("usbip interval %u\n",cmd.interval);
+#ifdef LINUX
+     printf("usbip setup %llu\n",cmd.setup);
+#else
+     printf("usbip setup %I64u\n",cmd.setup);
+#endif // LINUX
+     printf("usbip buffer lenght  %u\n",cmd.transfer_buffer_length);
+#endif // _DEBUGPRN
+     usb_req.command=0;
+     usb_req.seqnum=cmd.seqnum;
+     usb_req.devid=cmd.devid;
+     usb_req.direction=cmd.direction;
+     usb_req.ep=cmd.ep;
+     usb_req.status=0;
+     usb_req.actual_length=0;
+     usb_req.start_frame=0;
+     usb_req.number_of_packets=0;
+     usb_req.error_count=0;
+     usb_req.setup=cmd.setup;
+     
+     if(cmd.command == 1)
+       handle_usb_request(conn, &usb_req, msg + USBIP_HEADER_SIZE, cmd.transfer_buffer_length);
+     
+
+     if(cmd.command == 2) //unlink urb
+     {
+        // header is unpacked already. seqnum_urb is at the transfer_flags offset
+        handle_unlink(conn, (USBIP_CMD_UNLINK *)&cmd);
+     }
+
+     if(cmd.command > 2)
+     {
+        printf("Unknown USBIP cmd!\n");  
+        return -1;  
+     };
+  } 
+  return conn->error ? -1 : 0;
+}
+
+// read what the socket has and handle all complete messages. returns -1 if the connection must be closed.
+int usbip_receive(USBIP_CONNECTION *conn, const USB_DEVICE_DESCRIPTOR *dev_dsc)
+{
+  ssize_t nb;
+  size_t pos = 0;
+  int len;
+
+  nb = recv(conn->sockfd, conn->rbuf + conn->rlen, USBIP_BUFFER_SIZE - conn->rlen, 0);
+  if(nb == 0)
+    return -1;
+  if(nb < 0)
+  {
+    if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+      return 0;
+    printf ("receive error : %s \n", strerror (errno));
+    return -1;
+  }
+  conn->rlen += nb;
+
+  // several commands can come in one read, the last one can be cut
+  while(pos < conn->rlen)
+  {
+    len = usbip_message_length(conn, conn->rbuf + pos, conn->rlen - pos);
+    if(len < 0)
+      return -1;
+    if(len == 0 || (size_t)len > conn->rlen - pos)
+      break;
+
+    if(usbip_handle_request(conn, dev_dsc, conn->rbuf + pos, len) < 0)
+      return -1;
+    pos += len;
+  }
+
+  // keep the incomplete tail for the next read
+  memmove(conn->rbuf, conn->rbuf + pos, conn->rlen - pos);
+  conn->rlen -= pos;
+  return 0;
+}
+
+// EPOLLOUT: send the queued replies
+int usbip_flush(USBIP_CONNECTION *conn)
+{
+  ssize_t nb = send(conn->sockfd, conn->wbuf, conn->wlen, MSG_NOSIGNAL);
+  if(nb < 0)
+  {
+    if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+      return 0;
+    printf ("send error : %s \n", strerror (errno));
+    return -1;
+  }
+  memmove(conn->wbuf, conn->wbuf + nb, conn->wlen - nb);
+  conn->wlen -= nb;
+
+  if(conn->wlen == 0)
+  {
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.ptr = conn;
+    epoll_ctl(conn->epollfd, EPOLL_CTL_MOD, conn->sockfd, &ev);
+  }
+  return 0;
+}
+
+void usbip_close_connection(USBIP_CONNECTION *conn)
+{
+  epoll_ctl(conn->epollfd, EPOLL_CTL_DEL, conn->sockfd, nullptr);
+  if(conn->attached)
+  {
+    handle_device_detach(conn);
+    busowner[conn->busid] = nullptr;
+  }
+  printf("Connection closed. bus id: %d-%d\n", usbip_bus, conn->busid + 1);
+  close(conn->sockfd);
+  free(conn);
+}
+
 void
-usbip_run (const USB_DEVICE_DESCRIPTOR *dev_dsc)                                /* simple TCP server */
+usbip_run (const USB_DEVICE_DESCRIPTOR *dev_dsc, int port, int bus)            /* epoll TCP server, one USBIP_CONNECTION per client */
 {
   struct sockaddr_in serv, cli;
-  int listenfd, sockfd, nb;
+  int listenfd, sockfd, epollfd, nfds, i;
+  struct epoll_event ev, events[USBIP_MAX_EVENTS];
 #ifdef LINUX
   unsigned int clilen;
 #else
   int clilen;
 #endif
-  unsigned char attached;
-
 
+  usbip_bus = bus;
 
 #ifndef LINUX
   WSAStartup (wVersionRequested, &wsaData);
@@ -349,7 +783,7 @@ usbip_run (const USB_DEVICE_DESCRIPTOR *dev_dsc)
   memset (&serv, 0, sizeof (serv));
   serv.sin_family = AF_INET;
   serv.sin_addr.s_addr = htonl (INADDR_ANY);
-  serv.sin_port = htons (TCP_SERV_PORT);
+  serv.sin_port = htons (port);
 
   if (bind (listenfd, (sockaddr *) & serv, sizeof (serv)) < 0)
     {
@@ -363,168 +797,117 @@ usbip_run (const USB_DEVICE_DESCRIPTOR *dev_dsc)
       exit (1);
     };
 
-  for (;;)
+  if ((epollfd = epoll_create1 (0)) < 0)
     {
+      printf ("epoll error : %s \n", strerror (errno));
+      exit (1);
+    };
 
-      clilen = sizeof (cli);
-      if (
-          (sockfd =
-           accept (listenfd, (sockaddr *) & cli,  & clilen)) < 0)
+  // listen socket has data.ptr == nullptr, clients have their USBIP_CONNECTION
+  ev.events = EPOLLIN;
+  ev.data.ptr = nullptr;
+  if (epoll_ctl (epollfd, EPOLL_CTL_ADD, listenfd, &ev) < 0)
+    {
+      printf ("epoll_ctl error : %s \n", strerror (errno));
+      exit (1);
+    };
+
+  // device events (worker results, timers) come with data.ptr == &devev
+  static int devev = 0;
+  int devfd = device_events_fd ();
+  if (devfd >= 0)
+    {
+      ev.events = EPOLLIN;
+      ev.data.ptr = &devev;
+      if (epoll_ctl (epollfd, EPOLL_CTL_ADD, devfd, &ev) < 0)
         {
-          printf ("accept error : %s \n", strerror (errno));
+          printf ("epoll_ctl error : %s \n", strerror (errno));
           exit (1);
         };
-        printf("Connection address:%s\n",inet_ntoa(cli.sin_addr));
-        attached=0;
-  
-        while(1)
+    }
+
+  for (;;)
+    {
+      nfds = epoll_wait (epollfd, events, USBIP_MAX_EVENTS, device_events_timeout ());
+      if (nfds < 0)
         {
-          if(! attached)
-          {
-             OP_REQ_DEVLIST req;
-             if ((nb = recv (sockfd, (char *)&req, sizeof(OP_REQ_DEVLIST), 0)) != sizeof(OP_REQ_DEVLIST))
-             {
-               //printf ("receive error : %s \n", strerror (errno));
-               break;
-             };
-#ifdef _DEBUG
-             print_recv((char *)&req, sizeof(OP_REQ_DEVLIST),"OP_REQ_DEVLIST");
-#endif
-             req.command=ntohs(req.command);
-             printf("Header Packet\n");  
-             printf("command: 0x%02X\n",req.command);
-             if(req.command == 0x8005)
-             {
-               OP_REP_DEVLIST list;
-               printf("list of devices\n");
-
-               handle_device_list(dev_dsc,&list);
-
-               if (send (sockfd, (char *)&list.header, sizeof(OP_REP_DEVLIST_HEADER), 0) != (int)sizeof(OP_REP_DEVLIST_HEADER))
-               {
-                   printf ("send error : %s \n", strerror (errno));
-                   break;
-               };
-               if (send (sockfd, (char *)&list.device, sizeof(OP_REP_DEVLIST_DEVICE), 0) != (int)sizeof(OP_REP_DEVLIST_DEVICE))
-               {
-                   printf ("send error : %s \n", strerror (errno));
-                   break;
-               };
-               if (send (sockfd, (char *)list.interfaces, sizeof(OP_REP_DEVLIST_INTERFACE)*list.device.bNumInterfaces, 0) != 
-                   (int)sizeof(OP_REP_DEVLIST_INTERFACE)*list.device.bNumInterfaces)
-               {
-                   printf ("send error : %s \n", strerror (errno));
-                   break;
-               };
-               free(list.interfaces);
-             }
-             else if(req.command == 0x8003) 
-             {
-               char busid[32];
-               OP_REP_IMPORT rep;
-               printf("attach device\n");
-               if ((nb = recv (sockfd, busid, 32, 0)) != 32)
-               {
-                 printf ("receive error : %s \n", strerror (errno));
-                 break;
-               };
-#ifdef _DEBUG
-             print_recv(busid, 32,"Busid");
-#endif
-               handle_attach(dev_dsc,&rep);
-               if (send (sockfd, (char *)&rep, sizeof(OP_REP_IMPORT), 0) != sizeof(OP_REP_IMPORT))
-               {
-                   printf ("send error : %s \n", strerror (errno));
-                   break;
-               };
-               attached = 1;
-             }
-          }
-          else
-          {
-#ifdef _DEBUGPRN
-             printf("------------------------------------------------\n"); 
-             printf("handles requests\n");
-#endif // _DEBUGPRN
-             USBIP_CMD_SUBMIT cmd;
-             USBIP_RET_SUBMIT usb_req;
-             if ((nb = recv (sockfd, (char *)&cmd, sizeof(USBIP_CMD_SUBMIT), 0)) != sizeof(USBIP_CMD_SUBMIT))
-             {
-               printf ("receive len: %d error : %s \n", nb, strerror (errno));
-               break;
-             };
-#ifdef _DEBUG
-             print_recv((char *)&cmd, sizeof(USBIP_CMD_SUBMIT),"USBIP_CMD_SUBMIT");
-#endif
-             unpack((int *)&cmd,sizeof(USBIP_CMD_SUBMIT));               
-#ifdef _DEBUGPRN
-             printf("usbip cmd %u\n",cmd.command);
-             printf("usbip seqnum %u\n",cmd.seqnum);
-             printf("usbip devid %u\n",cmd.devid);
-             printf("usbip direction %u\n",cmd.direction);
-             printf("usbip ep %u\n",cmd.ep);
-             printf("usbip flags %u\n",cmd.transfer_flags);
-             printf("usbip number of packets %u\n",cmd.number_of_packets);
-             printf("usbip interval %u\n",cmd.interval);
-#ifdef LINUX
-             printf("usbip setup %llu\n",cmd.setup);
-#else
-             printf("usbip setup %I64u\n",cmd.setup);
-#endif // LINUX
-             printf("usbip buffer lenght  %u\n",cmd.transfer_buffer_length);
-#endif // _DEBUGPRN
-             usb_req.command=0;
-             usb_req.seqnum=cmd.seqnum;
-             usb_req.devid=cmd.devid;
-             usb_req.direction=cmd.direction;
-             usb_req.ep=cmd.ep;
-             usb_req.status=0;
-             usb_req.actual_length=0;
-             usb_req.start_frame=0;
-             usb_req.number_of_packets=0;
-             usb_req.error_count=0;
-             usb_req.setup=cmd.setup;
-             
-             if(cmd.command == 1)
-               handle_usb_request(sockfd, &usb_req, cmd.transfer_buffer_length);
-             
+          if (errno == EINTR)
+            continue;
+          printf ("epoll_wait error : %s \n", strerror (errno));
+          break;
+        };
+
+      for (i = 0; i < nfds; i++)
+        {
+          USBIP_CONNECTION *conn = (USBIP_CONNECTION *)events[i].data.ptr;
 
-             if(cmd.command == 2) //unlink urb
-             {
-                printf("####################### Unlink URB %u  (not working!!!)\n",cmd.transfer_flags);
-             //FIXME
-               /*              
-                USBIP_RET_UNLINK ret;  
-                printf("####################### Unlink URB %u\n",cmd.transfer_flags);
-                ret.command=htonl(0x04);
-                ret.devid=htonl(cmd.devid);
-                ret.direction=htonl(cmd.direction);
-                ret.ep=htonl(cmd.ep);
-                ret.seqnum=htonl(cmd.seqnum);
-                ret.status=htonl(1);
- 
-                if (send (sockfd, (char *)&ret, sizeof(USBIP_RET_UNLINK), 0) != sizeof(USBIP_RET_UNLINK))
+          if (events[i].data.ptr == &devev)
+            {
+              handle_device_events ();
+              continue;
+            }
+
+          if (conn == nullptr)
+            {
+              clilen = sizeof (cli);
+              if ((sockfd = accept (listenfd, (sockaddr *) & cli,  & clilen)) < 0)
                 {
-                  printf ("send error : %s \n", strerror (errno));
-                  exit(-1);
+                  printf ("accept error : %s \n", strerror (errno));
+                  continue;
                 };
-               */ 
-             }
+              printf("Connection address:%s\n",inet_ntoa(cli.sin_addr));
 
-             if(cmd.command > 2)
-             {
-                printf("Unknown USBIP cmd!\n");  
-                close (sockfd);
-#ifndef LINUX
-                WSACleanup ();
-#endif
-                return;  
-             };
- 
-          } 
-       }
-       close (sockfd);
+              // header and payload go out in one writev, don't let Nagle hold the reply
+              int nodelay = 1;
+              if (setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, (const char*)&nodelay, sizeof(nodelay)) < 0)
+                  perror("setsockopt(TCP_NODELAY) failed");
+              fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL, 0) | O_NONBLOCK);
+
+              conn = (USBIP_CONNECTION *)calloc(1, sizeof(USBIP_CONNECTION));
+              if (conn == nullptr)
+                {
+                  close (sockfd);
+                  continue;
+                }
+              conn->sockfd = sockfd;
+              conn->epollfd = epollfd;
+              conn->attached = 0;
+              conn->busid = -1;
+
+              ev.events = EPOLLIN | EPOLLRDHUP;
+              ev.data.ptr = conn;
+              if (epoll_ctl (epollfd, EPOLL_CTL_ADD, sockfd, &ev) < 0)
+                {
+                  printf ("epoll_ctl error : %s \n", strerror (errno));
+                  close (sockfd);
+                  free (conn);
+                }
+              continue;
+            }
+
+          if (events[i].events & (EPOLLERR | EPOLLHUP))
+            {
+              usbip_close_connection (conn);
+              continue;
+            }
+
+          if ((events[i].events & EPOLLOUT) && usbip_flush (conn) < 0)
+            {
+              usbip_close_connection (conn);
+              continue;
+            }
+
+          if ((events[i].events & (EPOLLIN | EPOLLRDHUP)) && usbip_receive (conn, dev_dsc) < 0)
+            usbip_close_connection (conn);
+        }
+
+      // timers that are due, also when the clients keep the loop busy
+      if (device_events_timeout () == 0)
+        handle_device_events ();
     };
+
+  close (epollfd);
+  close (listenfd);
 #ifndef LINUX
   WSACleanup ();
 #endif
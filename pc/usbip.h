@@ -35,6 +35,10 @@
 #include<sys/un.h>
 #include<netinet/in.h>
 #include<arpa/inet.h>
+#include<sys/epoll.h>
+#include<sys/uio.h>
+#include<netinet/tcp.h>
+#include<fcntl.h>
 #define        min(a,b)        ((a) < (b) ? (a) : (b))
 #else
 #include<winsock.h>
@@ -49,6 +53,12 @@
 #include<stdint.h>
 //defines
 #define        TCP_SERV_PORT        3240
+#define        USBIP_BUSID_COUNT    4     // exported bus ids <bus>-1..<bus>-N
+#define        USBIP_MAX_EVENTS     16    // epoll events per wait
+#define        USBIP_BUFFER_SIZE    (2 * (USBIP_HEADER_SIZE + CCID_MAX_MESSAGE_LENGTH)) // per connection read and write buffers
+#define        USBIP_HEADER_SIZE    48    // CMD_SUBMIT/RET_SUBMIT/UNLINK header
+#define        USBIP_MAX_PENDING_URB 16   // parked IN URBs per connection
+#define        USBIP_SPEED_HIGH     3
 typedef struct sockaddr sockaddr;
 
 
@@ -66,6 +76,7 @@ typedef struct sockaddr sockaddr;
 #define USB_DESCRIPTOR_INTERFACE        0x04    // Interface Descriptor.
 #define USB_DESCRIPTOR_ENDPOINT         0x05    // Endpoint Descriptor.
 #define USB_DESCRIPTOR_DEVICE_QUALIFIER 0x06    // Device Qualifier.
+#define USB_DESCRIPTOR_OTHER_SPEED_CONFIGURATION 0x07    // Other Speed Configuration.
 #define USB_DESCRIPTOR_ICC              0x21    // ICC descriptor.
 
 typedef struct __attribute__ ((__packed__)) _USB_DEVICE_DESCRIPTOR
@@ -236,8 +247,10 @@ typedef struct __attribute__ ((__packed__)) _CONFIG_CDC
 #define CCID_OUT_EP                            0x04U  /* EP1 for data OUT */
 #define CCID_CMD_EP                            0x85U  /* EP2 for CDC commands */
 
-#define CCID_DATA_PACKET_SIZE                  64
+#define CCID_DATA_PACKET_SIZE                  512    // high-speed bulk
+#define CCID_FS_DATA_PACKET_SIZE               64     // full-speed bulk, other speed configuration
 #define CCID_HEADER_SIZE                       10
+#define CCID_MAX_MESSAGE_LENGTH                65544  // extended APDU level, header + abData
 
 /*CCID specification version 1.10*/
 #define CCID1_10                               0x0110
@@ -516,6 +529,7 @@ int devid;
 int direction;
 int ep;
 int seqnum_urb;
+char padding[24];
 }USBIP_CMD_UNLINK;
 
 
@@ -527,6 +541,7 @@ int devid;
 int direction;
 int ep;
 int status;
+char padding[24];
 }USBIP_RET_UNLINK;
 
 
@@ -543,18 +558,56 @@ typedef struct  __attribute__ ((__packed__)) _StandardDeviceRequest
 }StandardDeviceRequest;
 
 
-void send_usb_req(int sockfd, USBIP_RET_SUBMIT * usb_req, char * data, unsigned int size, unsigned int status);
-void usbip_run (const USB_DEVICE_DESCRIPTOR *dev_dsc);
+//================= IN URB waiting for data
+typedef struct _USBIP_URB
+{
+USBIP_RET_SUBMIT req;   // reply header, host byte order
+int ep;
+int length;             // transfer_buffer_length
+}USBIP_URB;
+
+//================= one per client socket
+typedef struct _USBIP_CONNECTION
+{
+int sockfd;
+int epollfd;
+unsigned char attached;
+unsigned char error;  // send failed, connection closes after the current event
+int busid;            // index of the attached bus id, -1 if not attached
+void *data;           // device state, owned by handle_device_attach/handle_device_detach
+size_t rlen;          // received bytes not parsed yet
+size_t wlen;          // bytes waiting for EPOLLOUT
+int urbcount;         // parked URBs, oldest first
+USBIP_URB urbs[USBIP_MAX_PENDING_URB];
+char rbuf[USBIP_BUFFER_SIZE];
+char wbuf[USBIP_BUFFER_SIZE];
+}USBIP_CONNECTION;
+
+
+int  usbip_send(USBIP_CONNECTION *conn, const struct iovec *iov, int iovcnt);
+void send_usb_req(USBIP_CONNECTION *conn, USBIP_RET_SUBMIT * usb_req, char * data, unsigned int size, unsigned int status);
+int  usbip_urb_park(USBIP_CONNECTION *conn, USBIP_RET_SUBMIT *usb_req, int length);
+int  usbip_urb_complete(USBIP_CONNECTION *conn, int ep, char *data, unsigned int size, unsigned int status);  // bytes sent or -1
+int  usbip_urb_pending(USBIP_CONNECTION *conn, int ep);
+void usbip_busid_name(int busid, char *name);  // "<bus>-<busid + 1>", name has 32 bytes
+void usbip_run (const USB_DEVICE_DESCRIPTOR *dev_dsc, int port, int bus);
 
 //implemented by user
 extern const USB_DEVICE_DESCRIPTOR dev_dsc;
 extern const USB_DEVICE_QUALIFIER_DESCRIPTOR  dev_qua;
 extern const char * configuration;
+extern const char * configuration_other_speed;  // full speed, the device qualifier announces it
 extern const USB_INTERFACE_DESCRIPTOR *interfaces[];
 extern const unsigned char *strings[];
 
-void handle_data(int sockfd, USBIP_RET_SUBMIT *usb_req, int bl);
-void handle_unknown_control(int sockfd, StandardDeviceRequest * control_req, USBIP_RET_SUBMIT *usb_req);
+int  device_events_fd(void);       // fd for the epoll loop, -1 - none
+int  device_events_timeout(void);  // ms until handle_device_events is due, -1 - infinite
+void handle_device_events(void);   // device_events_fd readable or timeout
+int  handle_device_attach(USBIP_CONNECTION *conn);  // 0 - ok
+void handle_device_detach(USBIP_CONNECTION *conn);
+// bl - transfer_buffer_length. data - OUT transfer payload (bl bytes) already received with the command
+void handle_data(USBIP_CONNECTION *conn, USBIP_RET_SUBMIT *usb_req, char *data, int bl);
+void handle_unknown_control(USBIP_CONNECTION *conn, StandardDeviceRequest * control_req, USBIP_RET_SUBMIT *usb_req, char *data);
 
 #endif /* USBIP_H_ */
 
@@ -295,6 +295,31 @@ class OpenPGP_Card(object):
             raise ValueError("%02x%02x" % (sw[0], sw[1]))
         return True
 
+    # vendor. returns {tag: value} for the readable tags
+    def cmd_get_multiple_data(self, tags):
+        cmd_data = iso7816_compose(0xed, 0x00, 0x00, b"".join(pack('>H', t) for t in tags), le=254)
+        sw = self.__reader.send_cmd(cmd_data)
+        if len(sw) < 2:
+            raise ValueError(sw)
+        if len(sw) == 2 and sw[0] == 0x61:
+            r = self.cmd_get_response(sw[1])
+        elif sw[-2] == 0x90 and sw[-1] == 0x00:
+            r = sw[0:-2]
+        else:
+            raise ValueError("%02x%02x" % (sw[-2], sw[-1]))
+
+        result = {}
+        while r:
+            tag = unpack('>H', r[0:2])[0]
+            if r[2] < 0x80:
+                length, pos = r[2], 3
+            else:
+                n = r[2] & 0x7f
+                length, pos = int.from_bytes(r[3:3 + n], 'big'), 3 + n
+            result[tag] = r[pos:pos + length]
+            r = r[pos + length:]
+        return result
+
     def cmd_put_data(self, tagh, tagl, content):
         cmd_data = iso7816_compose(0xda, tagh, tagl, content)
         sw = self.__reader.send_cmd(cmd_data)
@@ -363,6 +388,19 @@ class OpenPGP_Card(object):
             return self.send_apdu(0x2a, p1, p2, data)
 
 
+    # one apdu, returns data with status word. no 61xx handling
+    def send_raw(self, ins, p1, p2, data, le=None, cls=0x00):
+        cmd_data = iso7816_compose(ins, p1, p2, data, cls=cls, le=le)
+        return self.__reader.send_cmd(cmd_data)
+
+    def cmd_pso_raw(self, p1, p2, data):
+        return self.send_raw(0x2a, p1, p2, data)
+
+    # any applet. returns the status word
+    def cmd_select_aid(self, aid):
+        r = self.send_raw(0xa4, 0x04, 0x00, aid)
+        return r[-2:]
+
     def cmd_internal_authenticate(self, data):
         if self.__reader.is_tpdu_reader():
             return self.send_apdu(0x88, 0, 0, data, le=256)
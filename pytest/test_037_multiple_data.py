@@ -0,0 +1,38 @@
+"""
+test_037_multiple_data.py - test vendor GET MULTIPLE DATA (INS ed)
+
+Copyright (C) 2019  SoloKeys
+
+"""
+
+import pytest
+
+from skip_gnuk_only_tests import *
+
+from card_const import *
+from constants_for_test import *
+
+
+tags = [0x6e, 0x65, 0x7a, 0x5f50, 0x5e, 0xc4, 0x7f21]
+
+
+def test_same_as_get_data(card):
+    v = card.cmd_get_multiple_data(tags)
+    assert list(v.keys()) == tags
+    for tag in tags:
+        data = card.cmd_get_data(tag >> 8, tag & 0xff)
+        assert v[tag] == (data or b"")
+
+
+def test_access_denied_skipped(card):
+    # 0104 needs PW3, resetting code is never readable
+    v = card.cmd_get_multiple_data([0x5e, 0x0104, 0xd3, 0xc4])
+    assert list(v.keys()) == [0x5e, 0xc4]
+
+
+def test_wrong_length(card):
+    v = card.cmd_get_multiple_data([0x6e, 0x65])
+    assert list(v.keys()) == [0x6e, 0x65]
+
+    with pytest.raises(ValueError):
+        card.cmd_get_multiple_data([])
@@ -0,0 +1,60 @@
+"""
+test_038_pso_get_response.py - test vendor DO 0111: PSO data directly or via GET RESPONSE
+
+Copyright (C) 2019  SoloKeys
+
+"""
+
+from skip_gnuk_only_tests import *
+
+from card_const import *
+from constants_for_test import *
+from Crypto.Cipher import AES
+
+
+def encrypted():
+    aes = AES.new(AES128key, AES.MODE_CBC, AESiv)
+    return b"\x02" + aes.encrypt(AESPlainText)
+
+
+def test_setup(card):
+    assert card.verify(3, FACTORY_PASSPHRASE_PW3)
+    assert card.cmd_put_data(0x00, 0xd5, AES128key)
+    assert card.verify(2, FACTORY_PASSPHRASE_PW1)
+
+
+def test_direct_by_default(card):
+    r = card.cmd_pso_raw(0x86, 0x80, AESPlainText)
+    assert r[-2:] == b"\x90\x00"
+    assert r[:-2] == encrypted()
+
+
+def test_get_response(card):
+    assert card.cmd_put_data(0x01, 0x11, b"\x01")
+    assert card.cmd_get_data(0x01, 0x11) == b"\x01"
+
+    r = card.cmd_pso_raw(0x86, 0x80, AESPlainText)
+    assert r == b"\x61" + bytes([len(encrypted())])
+    assert card.cmd_get_response(r[1]) == encrypted()
+
+    # the same with the usual helper
+    assert card.cmd_pso(0x86, 0x80, AESPlainText) == encrypted()
+
+
+def test_wrong_value(card):
+    try:
+        card.cmd_put_data(0x01, 0x11, b"\x02")
+        assert False
+    except ValueError:
+        pass
+
+
+def test_back_to_direct(card):
+    assert card.cmd_put_data(0x01, 0x11, b"\x00")
+    r = card.cmd_pso_raw(0x86, 0x80, AESPlainText)
+    assert r[-2:] == b"\x90\x00"
+
+
+def test_verify_reset(card):
+    assert card.cmd_verify_reset(2)
+    assert card.cmd_verify_reset(3)
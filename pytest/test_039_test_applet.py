@@ -0,0 +1,86 @@
+"""
+test_039_test_applet.py - test the benchmark applet (AID fafafafa)
+
+Copyright (C) 2019  SoloKeys
+
+"""
+
+from skip_gnuk_only_tests import *
+
+from card_const import *
+from constants_for_test import *
+
+
+def test_select(card):
+    assert card.cmd_select_aid(b"\xfa\xfa\xfa\xfa") == b"\x90\x00"
+
+
+def test_echo(card):
+    data = bytes(range(200))
+    assert card.send_raw(0x01, 0x00, 0x00, data) == data + b"\x90\x00"
+
+
+def test_return(card):
+    assert card.send_raw(0x02, 0x00, 0x10, b"") == bytes(range(16)) + b"\x90\x00"
+
+    # more than a short response
+    r = card.send_raw(0x02, 0x01, 0x2c, b"")
+    assert r[0] == 0x61
+    v = card.cmd_get_response(r[1] if r[1] else 0xff)
+    assert v == bytes([i & 0xff for i in range(300)])
+
+
+def crypto(card, op, data=b""):
+    r = card.send_raw(0x04, op, 0x00, data)
+    if r[0] == 0x61:
+        return card.cmd_get_response(r[1] if r[1] else 0xff)
+    assert r[-2:] == b"\x90\x00"
+    return r[:-2]
+
+
+def test_sleep(card):
+    assert card.send_raw(0x03, 0x03, 0xe8, b"") == b"\x90\x00"
+
+
+def test_crypto(card):
+    # GenerateRandom, 32 bytes
+    r = card.send_raw(0x04, 0x00, 0x20, b"")
+    assert len(r) == 34 and r[-2:] == b"\x90\x00"
+
+    # AESEncrypt and AESDecrypt with the test key
+    ct = card.send_raw(0x04, 0x01, 0x00, AESPlainText)
+    assert ct[-2:] == b"\x90\x00"
+    assert card.send_raw(0x04, 0x02, 0x00, ct[:-2]) == AESPlainText + b"\x90\x00"
+
+    # RSAGenKey only with 2048, 3072 and 4096 bits
+    for p2 in (0x00, 0x01, 0x09, 0x20, 0xff):
+        assert card.send_raw(0x04, 0x03, p2, b"") == b"\x6b\x00"
+
+    # test keys: RSA 2048 with e = 65537 and ansix9p256r1
+    n = int.from_bytes(crypto(card, 0x04), "big")
+    assert n.bit_length() == 2048
+    assert len(crypto(card, 0x09)) == 65
+
+    digest = bytes(range(32))
+    sig = crypto(card, 0x05, digest)
+    assert len(sig) == 256
+    em = pow(int.from_bytes(sig, "big"), 65537, n).to_bytes(256, "big")
+    assert em == b"\x00\x01" + b"\xff" * (256 - 3 - len(digest)) + b"\x00" + digest
+
+    em = b"\x00\x02" + b"\x5a" * (256 - 3 - len(digest)) + b"\x00" + digest
+    cg = pow(int.from_bytes(em, "big"), 65537, n).to_bytes(256, "big")
+    assert crypto(card, 0x06, cg) == digest
+
+    assert len(crypto(card, 0x0a, digest)) == 64
+    assert len(crypto(card, 0x0c)) == 32
+
+    # unknown primitive
+    assert card.send_raw(0x04, 0x7f, 0x00, b"") == b"\x6b\x00"
+
+
+def test_wrong_ins(card):
+    assert card.send_raw(0x05, 0x00, 0x00, b"") == b"\x6d\x00"
+
+
+def test_back_to_openpgp(card):
+    assert card.cmd_select_openpgp()
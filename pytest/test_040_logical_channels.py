@@ -0,0 +1,68 @@
+"""
+test_040_logical_channels.py - full size pending data on all the logical channels
+
+Copyright (C) 2019  SoloKeys
+
+"""
+
+import pytest
+
+from skip_gnuk_only_tests import *
+
+from card_const import *
+from constants_for_test import *
+
+
+TestAID = b"\xfa\xfa\xfa\xfa"
+channels = [0, 1, 2, 3]
+
+
+def get_response(card, channel, sw2):
+    result = b""
+    while True:
+        r = card.send_raw(0xc0, 0x00, 0x00, b"", le=sw2 if sw2 else 0xff, cls=channel)
+        result += r[:-2]
+        if r[-2:] == b"\x90\x00":
+            return result
+        assert r[-2] == 0x61
+        sw2 = r[-1]
+
+
+def test_open_channels(card):
+    for channel in channels[1:]:
+        assert card.send_raw(0x70, 0x00, channel, b"") == b"\x90\x00"
+    for channel in channels:
+        assert card.send_raw(0xa4, 0x04, 0x00, TestAID, cls=channel)[-2:] == b"\x90\x00"
+
+
+def test_pending_on_all_channels(card):
+    # 64 KB that waits for get response on 3 channels
+    for channel in channels[:-1]:
+        r = card.send_raw(0x02, 0xff, 0xff, b"", cls=channel)
+        assert r[-2] == 0x61
+
+    # and a chained command of the maximum size on the last one
+    data = bytes([i & 0xff for i in range(0xffff)])
+    last = channels[-1]
+    for pos in range(0, len(data) - 0xff, 0xff):
+        assert card.send_raw(0x01, 0x00, 0x00, data[pos:pos + 0xff], cls=0x10 | last) == b"\x90\x00"
+    pos = (len(data) - 1) // 0xff * 0xff
+    r = card.send_raw(0x01, 0x00, 0x00, data[pos:], cls=last)
+    assert r[-2] == 0x61
+    assert get_response(card, last, r[-1]) == data
+
+    for channel in channels[:-1]:
+        assert get_response(card, channel, 0) == bytes([i & 0xff for i in range(0xffff)])
+
+
+def test_further_interindustry_class(card):
+    # channels 4-19 are not supported
+    for cls in (0x40, 0x41, 0x4f, 0x50, 0x60):
+        assert card.send_raw(0x01, 0x00, 0x00, b"\x01", cls=cls) == b"\x68\x81"
+    assert card.send_raw(0x70, 0x00, 0x04, b"") == b"\x68\x81"
+
+
+def test_close_channels(card):
+    for channel in channels[1:]:
+        assert card.send_raw(0x70, 0x80, channel, b"") == b"\x90\x00"
+    assert card.cmd_select_openpgp()
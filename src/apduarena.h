@@ -0,0 +1,174 @@
+/*
+ Copyright 2019 SoloKeys Developers
+
+ Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ http://opensource.org/licenses/MIT>, at your option. This file may not be
+ copied, modified, or distributed except according to those terms.
+ */
+
+#ifndef SRC_APDUARENA_H_
+#define SRC_APDUARENA_H_
+
+#include <cstdint>
+#include <cstddef>
+#include "util.h"
+
+namespace Applet {
+
+// iso7816 extended length: Lc up to 65535, Le 0000 means 65536
+constexpr size_t APDUMaxDataLength = 0xffff;
+constexpr size_t APDUMaxResponseLength = 0x10000 + 2;
+
+constexpr size_t APDUArenaHeader = 8;
+
+// arena size that always has space for one buffer of len bytes
+constexpr size_t APDUArenaSpace(size_t len) {
+	return APDUArenaHeader + ((len + APDUArenaHeader - 1) & ~(APDUArenaHeader - 1));
+}
+
+// first fit allocator over a static block. gives bstr buffers with max_length() as capacity.
+// blocks are in address order with a header before each one, free neighbours are merged.
+// not thread safe.
+template <size_t Size>
+class APDUArena {
+private:
+	struct Block {
+		uint32_t size;  // with header
+		uint32_t used;
+	};
+	static_assert(sizeof(Block) == APDUArenaHeader, "see APDUArenaSpace");
+	static constexpr size_t Align = sizeof(Block);
+	static constexpr size_t MinBlock = 2 * Align;
+
+	alignas(Block) uint8_t memory[Size];
+
+	static constexpr size_t AlignSize(size_t len) {
+		return (len + Align - 1) & ~(Align - 1);
+	}
+	Block *First() {
+		return reinterpret_cast<Block *>(memory);
+	}
+	Block *Next(Block *blk) {
+		uint8_t *next = reinterpret_cast<uint8_t *>(blk) + blk->size;
+		if (next >= memory + sizeof(memory))
+			return nullptr;
+		return reinterpret_cast<Block *>(next);
+	}
+	static Block *Header(bstr &buf) {
+		return reinterpret_cast<Block *>(buf.uint8Data() - sizeof(Block));
+	}
+	static bstr Buffer(Block *blk, size_t len) {
+		return bstr(reinterpret_cast<uint8_t *>(blk + 1), len, blk->size - sizeof(Block));
+	}
+	// cut the tail of the block to a new free block
+	void Split(Block *blk, size_t size) {
+		if (blk->size - size < MinBlock)
+			return;
+		Block *rest = reinterpret_cast<Block *>(reinterpret_cast<uint8_t *>(blk) + size);
+		rest->size = blk->size - size;
+		rest->used = 0;
+		blk->size = size;
+	}
+	void Merge() {
+		for (Block *blk = First(); blk; blk = Next(blk)) {
+			Block *next;
+			while (!blk->used && (next = Next(blk)) && !next->used)
+				blk->size += next->size;
+		}
+	}
+public:
+	static_assert(Size % Align == 0 && Size >= MinBlock, "wrong arena size");
+
+	APDUArena() {
+		Reset();
+	}
+
+	void Reset() {
+		First()->size = Size;
+		First()->used = 0;
+	}
+
+	static constexpr bstr Empty() {
+		return bstr(nullptr, 0, 0);
+	}
+
+	static constexpr bool Allocated(const bstr &buf) {
+		return buf.data() != nullptr;
+	}
+
+	// empty buffer with capacity len. data() == nullptr if there is no space.
+	bstr Allocate(size_t len) {
+		size_t size = sizeof(Block) + AlignSize(len);
+		for (Block *blk = First(); blk; blk = Next(blk)) {
+			if (!blk->used && blk->size >= size) {
+				Split(blk, size);
+				blk->used = 1;
+				return Buffer(blk, 0);
+			}
+		}
+		return Empty();
+	}
+
+	void Free(bstr &buf) {
+		if (Allocated(buf)) {
+			Header(buf)->used = 0;
+			Merge();
+		}
+		buf = Empty();
+	}
+
+	// change capacity and keep the data. grows in place if the next block is free.
+	// returns false and keeps the buffer as is if there is no space.
+	bool Resize(bstr &buf, size_t len) {
+		if (!Allocated(buf)) {
+			buf = Allocate(len);
+			return Allocated(buf);
+		}
+
+		Block *blk = Header(buf);
+		size_t size = sizeof(Block) + AlignSize(len);
+		size_t datalen = MIN(buf.length(), len);
+
+		if (size > blk->size) {
+			Block *next = Next(blk);
+			if (next && !next->used && blk->size + next->size >= size) {
+				blk->size += next->size;
+			} else {
+				bstr nbuf = Allocate(len);
+				if (!Allocated(nbuf))
+					return false;
+				nbuf.append(buf.uint8Data(), datalen);
+				Free(buf);
+				buf = nbuf;
+				return true;
+			}
+		}
+
+		Split(blk, size);
+		Merge();
+		buf = Buffer(blk, datalen);
+		return true;
+	}
+
+	// the longest buffer Allocate gives now
+	size_t MaxAllocation() {
+		size_t res = 0;
+		for (Block *blk = First(); blk; blk = Next(blk))
+			if (!blk->used)
+				res = MAX(res, static_cast<size_t>(blk->size - sizeof(Block)));
+		return res;
+	}
+
+	size_t FreeSpace() {
+		size_t res = 0;
+		for (Block *blk = First(); blk; blk = Next(blk))
+			if (!blk->used)
+				res += blk->size - sizeof(Block);
+		return res;
+	}
+};
+
+} /* namespace Applet */
+
+#endif /* SRC_APDUARENA_H_ */
@@ -11,9 +11,68 @@
 #include "applets/apduconst.h"
 #include "applets/applet.h"
 #include "solofactory.h"
+#include "stats.h"
 
 namespace Applet {
 
+APDUExecutor::~APDUExecutor() {
+	for (uint8_t i = 0; i < LogicalChannelCount; i++)
+		ClearChaining(i);
+}
+
+void APDUExecutor::ClearChaining(uint8_t channel) {
+	arena.Free(channels[channel].sapdu);
+	arena.Free(channels[channel].sresult);
+	channels[channel].sresultpos = 0;
+}
+
+// iso7816-4 11.1.2. p1 00 - open channel p2 (0 - any free), p1 80 - close channel p2 (0 - channel of the cla)
+Util::Error APDUExecutor::ManageChannel(AppletStorage &appletStorage, APDUStruct &apdu, bstr &result) {
+	if (apdu.cla != 0) {
+		result.setAPDURes(APDUResponse::CLAnotSupported);
+		return Util::Error::WrongAPDUCLA;
+	}
+
+	if (apdu.p1 == 0x80) {
+		uint8_t channel = apdu.p2 ? apdu.p2 : apdu.channel;
+		auto err = appletStorage.CloseChannel(channel);
+		if (err != Util::Error::NoError) {
+			result.setAPDURes(APDUResponse::WrongParametersP1orP2);
+			return err;
+		}
+
+		ClearChaining(channel);
+		result.setAPDURes(APDUResponse::OK);
+		return Util::Error::NoError;
+	}
+
+	if (apdu.p1 != 0x00) {
+		result.setAPDURes(APDUResponse::WrongParametersP1orP2);
+		return Util::Error::WrongAPDUP1P2;
+	}
+
+	uint8_t channel = apdu.p2;
+	auto err = appletStorage.OpenChannel(channel);
+	if (err != Util::Error::NoError) {
+		result.setAPDURes(APDUResponse::LogicalChannelNotSupported);
+		return err;
+	}
+	ClearChaining(channel);
+
+	// opened from other than basic channel - the applet of that channel is selected in the new one
+	if (apdu.channel != 0) {
+		Applet *applet = appletStorage.GetSelectedApplet(apdu.channel);
+		if (applet != nullptr)
+			appletStorage.SelectApplet(channel, *applet->GetAID(), result);
+	}
+
+	result.clear();
+	if (apdu.p2 == 0)
+		result.append(channel);
+	result.appendAPDUres(APDUResponse::OK);
+	return Util::Error::NoError;
+}
+
 void APDUExecutor::SetResultError(bstr& result, Util::Error error) {
 	using Util::Error;
 	switch (error) {
@@ -51,6 +110,9 @@ void APDUExecutor::SetResultError(bstr& result, Util::Error error) {
 	case Error::ApplicationTerminated:
     	result.setAPDURes(APDUResponse::SelectInTerminationState);
 		break;
+	case Error::OutOfMemory:
+    	result.setAPDURes(APDUResponse::NotEnoughMemory);
+		break;
 
 	case Error::ErrorPutInData:
     	// error already in the data field
@@ -60,7 +122,7 @@ void APDUExecutor::SetResultError(bstr& result, Util::Error error) {
 	}
 }
 
-Util::Error APDUExecutor::Execute(bstr apdu, bstr& result) {
+Util::Error APDUExecutor::Execute(bstr apdu, bstr& result, size_t bufsize) {
 	result.clear();
 
 	if (apdu.length() < 4) {
@@ -76,7 +138,17 @@ Util::Error APDUExecutor::Execute(bstr apdu, bstr& result) {
 	if (errd != Util::Error::NoError)
 		return errd;
 
-	decapdu.printEx(32);
+	TRACE_INFO(Trace::APDUDecoded, 0, decapdu.TraceData());
+	Stats::Timer timer(Stats::INS, decapdu.ins);
+
+	if (decapdu.FurtherInterindustryClass() || !appletStorage.ChannelOpened(decapdu.channel)) {
+		result.setAPDURes(APDUResponse::LogicalChannelNotSupported);
+		return Util::Error::WrongAPDUCLA;
+	}
+	auto &[sapdu, sresult, sresultpos] = channels[decapdu.channel];
+
+	if (decapdu.ins == APDUcommands::ManageChannel)
+		return ManageChannel(appletStorage, decapdu, result);
 
 	// select applet
 	if (decapdu.ins == APDUcommands::Select) {
@@ -89,40 +161,47 @@ Util::Error APDUExecutor::Execute(bstr apdu, bstr& result) {
     		return Util::Error::WrongAPDUP1P2;
 		}
 
-		sapdu.clear();
-		sresult.clear();
+		ClearChaining(decapdu.channel);
 
-		auto err = appletStorage.SelectApplet(decapdu.data, result);
+		auto err = appletStorage.SelectApplet(decapdu.channel, decapdu.data, result);
     	SetResultError(result, err);
 		return err;
 	}
 
-    Applet *applet = appletStorage.GetSelectedApplet();
+    Applet *applet = appletStorage.GetSelectedApplet(decapdu.channel);
     if (applet != nullptr) {
 
-    	// output chaining (ins == 0xc0) data
-    	if (decapdu.ins == 0xc0) {
-    		if (sresult.length()) {
-    			// calc sending data length
-    			uint16_t need_len = decapdu.le;
+    	// output chaining data
+    	if (decapdu.ins == APDUcommands::GetResponse) {
+    		size_t rest = sresult.length() - sresultpos;
+    		if (rest) {
+    			// calc sending data length. Le 0 - all that fits
+    			size_t need_len = decapdu.le;
     			if (need_len == 0) {
     				if (decapdu.extended_apdu)
-    					need_len = MIN(0xffff, sresult.length());
+    					need_len = 0xffff;
     				else
-    					need_len = MIN(0xff, sresult.length());
+    					need_len = 0xff;
     			}
+    			need_len = MIN(need_len, rest);
+    			need_len = MIN(need_len, result.max_length() - 2);
 
-    			// copy result
-    			result.set(sresult.substr(0, need_len));
-    			sresult.del(0, need_len);
+    			// copy result. sresult is not changed, only the cursor moves
+    			result.set(sresult.substr(sresultpos, need_len));
+    			sresultpos += need_len;
+    			rest -= need_len;
 
     			// add 61xx response
     			uint8_t rest_len = 0;
-    			if (sresult.length() < 0xff)
-    				rest_len = sresult.length() & 0xff;
+    			if (rest < 0xff)
+    				rest_len = rest & 0xff;
 
-    			if (sresult.length())
+    			if (rest) {
     				result.appendAPDUres(0x6100 + rest_len);
+    			} else {
+    				arena.Free(sresult);
+    				sresultpos = 0;
+    			}
     		} else {
     			// error - don't have data
     			result.setAPDURes(APDUResponse::WrongLength);
@@ -130,36 +209,93 @@ Util::Error APDUExecutor::Execute(bstr apdu, bstr& result) {
     		return Util::Error::NoError;
     	}
 
-		sapdu.append(decapdu.data);
-    	// cla & 0x10 - input chaining apdu
-    	if (decapdu.cla & 0x10) {
-        	result.setAPDURes(APDUResponse::OK);
-    		return Util::Error::NoError;
+    	// data that waits for get response is dropped by any other command
+    	arena.Free(sresult);
+    	sresultpos = 0;
+
+    	// cla & 0x10 - input chaining apdu. the buffer starts at the Lc of the first part
+    	// and doubles when a part does not fit, up to the maximum command size.
+    	bool chaining = decapdu.cla & 0x10;
+    	if (chaining || arena.Allocated(sapdu)) {
+    		size_t len = sapdu.length() + decapdu.data.length();
+    		if (len > APDUMaxDataLength) {
+    			ClearChaining(decapdu.channel);
+    			result.setAPDURes(APDUResponse::WrongLength);
+    			return Util::Error::WrongAPDUDataLength;
+    		}
+    		if (!arena.Allocated(sapdu) || len > sapdu.max_length()) {
+    			size_t capacity = MIN(MAX(len, 2 * sapdu.max_length()), APDUMaxDataLength);
+    			if (!arena.Resize(sapdu, capacity)) {
+    				ClearChaining(decapdu.channel);
+    				result.setAPDURes(APDUResponse::NotEnoughMemory);
+    				return Util::Error::OutOfMemory;
+    			}
+    		}
+    		sapdu.append(decapdu.data);
+
+    		if (chaining) {
+    			result.setAPDURes(APDUResponse::OK);
+    			return Util::Error::NoError;
+    		}
+    		decapdu.data = sapdu;
+    		decapdu.lc = sapdu.length();
+    	}
+
+    	// in place the applet gets the full extended size in the transport buffer.
+    	// otherwise the response is built in the largest free block of the arena and shrunk after
+    	bool inplace = bufsize >= APDUMaxResponseLength;
+    	bstr response = inplace ? bstr(result.uint8Data(), 0, APDUMaxResponseLength) :
+    			arena.Allocate(MIN(APDUMaxResponseLength, arena.MaxAllocation()));
+    	if (!inplace && (!arena.Allocated(response) || response.max_length() < 2)) {
+    		arena.Free(response);
+    		ClearChaining(decapdu.channel);
+    		result.setAPDURes(APDUResponse::NotEnoughMemory);
+    		return Util::Error::OutOfMemory;
     	}
-    	decapdu.data = sapdu;
 
-    	// clear result buffer
-    	sresult.clear();
+    	Util::Error err = applet->APDUExchange(decapdu, response);
+    	SetResultError(response, err);
+      	TRACE_INFO(Trace::APDUResult, err);
+
+      	// free apdu buffer
+      	arena.Free(sapdu);
 
-    	Util::Error err = applet->APDUExchange(decapdu, sresult);
-    	SetResultError(sresult, err);
-      	printf("appdu result: %s\n", Util::GetStrError(err));
+      	// all the data in one response if it fits to Le and to the transport buffer.
+      	// short apdu without Le gets up to 256 bytes as with Le 00
+      	size_t le = decapdu.le ? decapdu.le : (decapdu.extended_apdu ? 0 : 0x100);
+      	bool fitsle = response.length() <= le + 2 && response.length() <= result.max_length();
 
-      	// clear apdu buffer
-		sapdu.clear();
+      	// hosts that expect 61xx after PSO. see PGPConst::PSOGetResponseDO
+      	bool forced = applet->ForceGetResponse(decapdu) && response.length() > 2;
+      	if ((response.length() > 0xfe && !fitsle) || forced) {
+      		// keep only the data that waits for get response
+      		if (inplace) {
+      			sresult = arena.Allocate(response.length());
+      			if (!arena.Allocated(sresult)) {
+      				ClearChaining(decapdu.channel);
+      				result.setAPDURes(APDUResponse::NotEnoughMemory);
+      				return Util::Error::OutOfMemory;
+      			}
+      			sresult.append(response);
+      		} else {
+      			sresult = response;
+      			arena.Resize(sresult, sresult.length());
+      		}
 
-		// some apdu commands (PSO) needs to have 6100 response!!!  tests bug!!!!!
-      	if (sresult.length() > 0xfe || (decapdu.ins == 0x2a && sresult.length() > 2)) {
       		if (sresult.length() > 0xff)
       			result.setAPDURes(0x6100);
       		else
       			result.setAPDURes(0x6100 + (sresult.length() & 0xff));
+      	} else if (inplace) {
+      		// already there
+      		result.set_length(response.length());
       	} else {
-      		result.append(sresult);
+      		result.append(response);
+      		arena.Free(response);
       	}
 
     } else {
-    	printf("applet not selected.\n");
+    	TRACE_ERROR(Trace::NotSelected, decapdu.channel);
     	result.setAPDURes(APDUResponse::ConditionsUseNotSatisfied);
     }
 
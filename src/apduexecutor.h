@@ -14,21 +14,46 @@
 #include <cstdlib>
 #include "util.h"
 #include "errors.h"
+#include "apduarena.h"
 #include "applets/appletstorage.h"
 #include "applets/apduconst.h"
 
 namespace Applet {
 
+// chained commands, responses of the transports with a small buffer and the data that waits
+// for get response of all the logical channels. buffers are taken while a command needs them,
+// 6A84 if there is no space. the device has room for a few KB only, the pc build
+// (Makefile) sets it so the channels can keep full extended apdus at once.
+#ifndef APDU_ARENA_SIZE
+#define APDU_ARENA_SIZE 0x2000
+#endif
+
+static_assert(APDU_ARENA_SIZE >= APDUArenaSpace(0x100 + 2), "arena must have space for a short response");
+
 class APDUExecutor {
 private:
-	uint8_t apduBuffer[1130];
-	uint8_t resultBuffer[1130];
-	bstr sapdu{apduBuffer, 0, sizeof(apduBuffer)};
-	bstr sresult{resultBuffer, 0, sizeof(resultBuffer)};
+	using Arena = APDUArena<APDU_ARENA_SIZE>;
+
+	// chaining of one logical channel. allocated from the arena only while there is chained data
+	struct ChannelChaining {
+		bstr sapdu = Arena::Empty();
+		bstr sresult = Arena::Empty();
+		size_t sresultpos = 0;  // get response reads sresult from here
+	};
+	ChannelChaining channels[LogicalChannelCount];
+	// each card has its own, so the cards of one process do not share any state
+	Arena arena;
 
 	void SetResultError(bstr &result, Util::Error error);
+	void ClearChaining(uint8_t channel);
+	Util::Error ManageChannel(AppletStorage &appletStorage, APDUStruct &apdu, bstr &result);
 public:
-	Util::Error Execute(bstr apdu, bstr &result);
+	~APDUExecutor();
+
+	// result.max_length() - the longest response the transport sends.
+	// bufsize >= APDUMaxResponseLength - the buffer of result has this size and the applet
+	// builds the response there in place, otherwise it goes via the arena and is copied.
+	Util::Error Execute(bstr apdu, bstr &result, size_t bufsize = 0);
 };
 
 } /* namespace OpenPGP */
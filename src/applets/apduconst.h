@@ -16,9 +16,13 @@
 #include <cstdio>
 #include "util.h"
 #include "error.h"
+#include "trace.h"
 
 namespace Applet {
 
+	// iso7816-4 5.4.2. basic channel and 3 channels of the first interindustry class
+	constexpr uint8_t LogicalChannelCount = 4;
+
 	enum APDUResponse {
 		SelectInTerminationState 	= 0x6285,
 		VerifyFailNoTryLeft 		= 0x63C0,
@@ -37,6 +41,7 @@ namespace Applet {
 		PermissionDenied			= 0x69f0,
 		IncorrectParamInDataField	= 0x6a80,
 		FileNotFound				= 0x6a82,
+		NotEnoughMemory				= 0x6a84,
 		ReferencedDataNotFound		= 0x6a88,
 		WrongParametersP1orP2		= 0x6b00,
 		INSnotSupported				= 0x6d00,
@@ -64,6 +69,9 @@ namespace Applet {
 		TerminateDF				= 0xe6,
 		ActivateFile			= 0x44,
 		SoloReboot				= 0xee,
+		SoloGetMultipleData		= 0xed,
+		ManageChannel			= 0x70,
+		GetResponse				= 0xc0,
 	};
 
 	class APDUStruct {
@@ -77,6 +85,7 @@ namespace Applet {
 	    uint32_t le;
 	    bool extended_apdu;
 	    uint8_t case_type;
+	    uint8_t channel;  // cla has no channel bits after decode
 
 	    constexpr void clear() {
 	    	cla = 0;
@@ -88,6 +97,12 @@ namespace Applet {
 	    	le = 0;
 	    	extended_apdu = false;
 	    	case_type = 0;
+	    	channel = 0;
+	    }
+
+	    // iso7816-4 5.4.1. channels 4-19, there are only LogicalChannelCount channels
+	    constexpr bool FurtherInterindustryClass() {
+	    	return (cla & 0xc0) == 0x40;
 	    }
 
 	    // iso7816:2013. 5.3.2 Decoding conventions for command bodies
@@ -99,6 +114,13 @@ namespace Applet {
 	    	p1 = idata[2];
 	    	p2 = idata[3];
 
+	    	// iso7816-4 5.4.1. first interindustry class: b1-b2 channel 0-3.
+	    	// further interindustry class (channels 4-19) stays in cla, see FurtherInterindustryClass
+	    	if ((cla & 0xe0) == 0x00) {
+	    		channel = cla & 0x03;
+	    		cla &= ~0x03;
+	    	}
+
 	    	uint8_t b0 = idata[4];
 
 	    	// case 1
@@ -199,8 +221,8 @@ namespace Applet {
 	    }
 
 	    constexpr void printEx(const size_t maxdatalen) {
-	        printf("APDU: %scase=0x%02x cla=0x%02x ins=0x%02x p1=0x%02x p2=0x%02x Lc=0x%02x(%d) Le=0x%02x(%d)",
-	               extended_apdu ? "[e]" : "", case_type, cla, ins, p1, p2, lc, lc, le, le);
+	        printf("APDU: %scase=0x%02x ch=%d cla=0x%02x ins=0x%02x p1=0x%02x p2=0x%02x Lc=0x%02x(%d) Le=0x%02x(%d)",
+	               extended_apdu ? "[e]" : "", case_type, channel, cla, ins, p1, p2, lc, lc, le, le);
 	        if (maxdatalen > 0) {
 	        	if (lc > 0) {
 	        		printf(" data: ");
@@ -212,6 +234,11 @@ namespace Applet {
 	        	printf("\n");
 	        }
 	    }
+
+	    // APDUDecoded trace record
+	    constexpr Trace::APDUDecodedData TraceData() const {
+	    	return {case_type, channel, cla, ins, p1, p2, extended_apdu, 0, lc, le};
+	    }
 	};
 
 }
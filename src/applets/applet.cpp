@@ -15,26 +15,30 @@ Applet::~Applet() {
 }
 
 Util::Error Applet::Init() {
-	selected = false;
+	selected = 0;
 
 	return Util::Error::NoError;
 }
 
-Util::Error Applet::Select(bstr &result) {
+Util::Error Applet::Select(uint8_t channel, bstr &result) {
 	result.clear();
-	selected = true;
+	selected |= 1 << channel;
 
 	return Util::Error::NoError;
 }
 
-Util::Error Applet::DeSelect() {
-	selected = false;
+Util::Error Applet::DeSelect(uint8_t channel) {
+	selected &= ~(1 << channel);
 
 	return Util::Error::NoError;
 }
 
-bool Applet::Selected() {
-	return selected;
+bool Applet::Selected(uint8_t channel) {
+	return selected & (1 << channel);
+}
+
+bool Applet::ForceGetResponse(APDUStruct &apdu) {
+	return false;
 }
 
 const bstr* Applet::GetAID() {
@@ -44,7 +48,7 @@ const bstr* Applet::GetAID() {
 Util::Error Applet::APDUExchange(APDUStruct &apdu, bstr &result) {
 	result.clear();
 
-	if (!selected)
+	if (!Selected(apdu.channel))
 		return Util::Error::AppletNotSelected;
 
 	return Util::Error::NoError;
@@ -22,7 +22,7 @@ namespace Applet {
 
 class Applet {
 protected:
-	bool selected;
+	uint8_t selected = 0;  // bit per logical channel
 	const bstr aid = "\x00"_bstr;
 
 	// TODO: applet config load/save
@@ -32,13 +32,15 @@ public:
 
 	virtual Util::Error Init();
 
-	virtual Util::Error Select(bstr &result);
-	virtual Util::Error DeSelect();
-	virtual bool Selected();
+	virtual Util::Error Select(uint8_t channel, bstr &result);
+	virtual Util::Error DeSelect(uint8_t channel);
+	virtual bool Selected(uint8_t channel);
 
 	virtual const bstr *GetAID();
 
 	virtual Util::Error APDUExchange(APDUStruct &apdu, bstr &result);
+	// the response of the command goes via 61xx and GET RESPONSE even if it fits Le
+	virtual bool ForceGetResponse(APDUStruct &apdu);
 };
 
 } // namespace Applet
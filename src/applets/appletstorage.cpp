@@ -11,7 +11,7 @@
 
 namespace Applet {
 
-Util::Error AppletStorage::SelectApplet(bstr aid, bstr &result) {
+Util::Error AppletStorage::SelectApplet(uint8_t channel, bstr aid, bstr &result) {
 	Applet *sapp = nullptr;
     for(const auto& app: applets) {
     	if (*app->GetAID() == aid) {
@@ -23,26 +23,56 @@ Util::Error AppletStorage::SelectApplet(bstr aid, bstr &result) {
     if (sapp == nullptr)
     	return Util::Error::AppletNotFound;
 
+    // other channels keep their applets
     for(const auto& app: applets)
-    	app->DeSelect();
+    	app->DeSelect(channel);
 
-    auto err = sapp->Select(result);
-    if (err != Util::Error::NoError)
-    	return err;
-
-    selectedApplet = sapp;
-	return Util::Error::NoError;
+    return sapp->Select(channel, result);
 }
 
-Applet* AppletStorage::GetSelectedApplet() {
+Applet* AppletStorage::GetSelectedApplet(uint8_t channel) {
     for(const auto& app: applets) {
-    	if (app->Selected())
+    	if (app->Selected(channel))
     		return app;
     }
 
 	return nullptr;
 }
 
+bool AppletStorage::ChannelOpened(uint8_t channel) {
+	return channel < LogicalChannelCount && (openChannels & (1 << channel));
+}
+
+Util::Error AppletStorage::OpenChannel(uint8_t &channel) {
+	if (channel == 0) {
+		for (uint8_t i = 1; i < LogicalChannelCount; i++) {
+			if (!ChannelOpened(i)) {
+				channel = i;
+				break;
+			}
+		}
+		if (channel == 0)
+			return Util::Error::ConditionsNotSatisfied;
+	}
+
+	if (channel >= LogicalChannelCount || ChannelOpened(channel))
+		return Util::Error::WrongAPDUP1P2;
+
+	openChannels |= 1 << channel;
+	return Util::Error::NoError;
+}
+
+Util::Error AppletStorage::CloseChannel(uint8_t channel) {
+	if (channel == 0 || !ChannelOpened(channel))
+		return Util::Error::WrongAPDUP1P2;
+
+	for(const auto& app: applets)
+		app->DeSelect(channel);
+
+	openChannels &= ~(1 << channel);
+	return Util::Error::NoError;
+}
+
 OpenPGPApplet& AppletStorage::GetOpenPGPApplet() {
 	return openPGPApplet;
 }
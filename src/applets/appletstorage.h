@@ -28,11 +28,17 @@ private:
 
 	std::array<Applet*, 2> applets = {&openPGPApplet, &testApplet};
 
-	Applet *selectedApplet = nullptr;
+	uint8_t openChannels = 0x01;  // bit per logical channel. basic channel is always open
 
 public:
-	Util::Error SelectApplet(bstr aid, bstr &result);
-	Applet *GetSelectedApplet();
+	Util::Error SelectApplet(uint8_t channel, bstr aid, bstr &result);
+	Applet *GetSelectedApplet(uint8_t channel);
+
+	bool ChannelOpened(uint8_t channel);
+	// MANAGE CHANNEL open. channel 0 - first free channel, returns the opened one
+	Util::Error OpenChannel(uint8_t &channel);
+	// MANAGE CHANNEL close. deselects the applet
+	Util::Error CloseChannel(uint8_t channel);
 
 	OpenPGPApplet &GetOpenPGPApplet();
 };
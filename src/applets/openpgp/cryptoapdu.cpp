@@ -16,6 +16,7 @@
 #include "applets/openpgpapplet.h"
 #include "applets/openpgp/openpgpconst.h"
 #include "applets/openpgp/openpgpstruct.h"
+#include "trace.h"
 
 namespace OpenPGP {
 
@@ -84,7 +85,6 @@ Util::Error APDUInternalAuthenticate::Process(uint8_t cla, uint8_t ins,
 		return err_check;
 
 	Factory::SoloFactory &solo = Factory::SoloFactory::GetSoloFactory();
-	File::FileSystem &filesystem = solo.GetFileSystem();
 	Crypto::CryptoEngine &crypto_e = solo.GetCryptoEngine();
 	OpenPGP::OpenPGPFactory &opgp_factory = solo.GetOpenPGPFactory();
 	OpenPGP::Security &security = opgp_factory.GetSecurity();
@@ -92,11 +92,11 @@ Util::Error APDUInternalAuthenticate::Process(uint8_t cla, uint8_t ins,
 	if (!security.GetAuth(OpenPGP::Password::PW1))
 		return Util::Error::AccessDenied;
 
-	OpenPGP::AlgoritmAttr alg;
-	auto err = alg.Load(filesystem, 0xc3); // authentication
-	if (err != Util::Error::NoError || alg.AlgorithmID == 0)
+	OpenPGP::AlgoritmAttr &alg = *security.GetAlgoritmAttr(0xc3); // authentication
+	if (alg.AlgorithmID == 0)
 		return Util::Error::DataNotFound;
 
+	Util::Error err;
 	if (alg.AlgorithmID == Crypto::AlgoritmID::RSA)
 		err = crypto_e.RSASign(File::AppletID::OpenPGP, OpenPGPKeyType::Authentication, data, dataOut);
 	else
@@ -139,9 +139,9 @@ Util::Error APDUGenerateAsymmetricKeyPair::Process(uint8_t cla,
 		return Util::Error::WrongAPDUDataLength;
 
 	Factory::SoloFactory &solo = Factory::SoloFactory::GetSoloFactory();
-	File::FileSystem &filesystem = solo.GetFileSystem();
 	Crypto::KeyStorage &key_storage = solo.GetKeyStorage();
 	Crypto::CryptoLib &cryptolib = solo.GetCryptoLib();
+	OpenPGP::Security &security = solo.GetOpenPGPFactory().GetSecurity();
 
 	OpenPGPKeyType key_type = OpenPGPKeyType::Unknown;
 	if (data[0] == OpenPGPKeyType::DigitalSignature ||
@@ -167,18 +167,20 @@ Util::Error APDUGenerateAsymmetricKeyPair::Process(uint8_t cla,
 	if (file_id == 0)
 		return Util::Error::DataNotFound;
 
-	printf("fileid = 0x%02x\n", file_id);
-	OpenPGP::AlgoritmAttr alg;
-	auto err = alg.Load(filesystem, file_id);
-	if (err != Util::Error::NoError || alg.AlgorithmID == 0)
+	OpenPGP::AlgoritmAttr &alg = *security.GetAlgoritmAttr(file_id);
+	if (alg.AlgorithmID == 0)
 		return Util::Error::DataNotFound;
 
+	uint8_t trace_data[] = {p1, static_cast<uint8_t>(alg.AlgorithmID)};
+	TRACE_DEBUG(Trace::KeyPair, file_id, bstr(trace_data, sizeof(trace_data)));
+
+	Util::Error err;
+
 	// OpenPGP v3.3.1 page 64
 	// 0x80 - Generation of key pair
 	// 0x81 - Reading of actual public key template
 	if (p1 == 0x80) {
 		if (alg.AlgorithmID == Crypto::AlgoritmID::RSA) {
-			printf("RSA\n");
 			Crypto::RSAKey rsa_key;
 			err = cryptolib.RSAGenKey(rsa_key, alg.RSAa.NLen);
 			if (err != Util::Error::NoError)
@@ -188,6 +190,11 @@ Util::Error APDUGenerateAsymmetricKeyPair::Process(uint8_t cla,
 			if (err != Util::Error::NoError)
 				return err;
 
+			// DS-Counter was reset
+			err = security.AfterSaveFileLogic(key_type);
+			if (err != Util::Error::NoError)
+				return err;
+
 			err = key_storage.GetPublicKey7F49(File::AppletID::OpenPGP, key_type, alg.AlgorithmID, dataOut);
 			if (err != Util::Error::NoError)
 				return err;
@@ -196,7 +203,6 @@ Util::Error APDUGenerateAsymmetricKeyPair::Process(uint8_t cla,
 		}
 
 		if (alg.AlgorithmID == Crypto::AlgoritmID::ECDSAforCDSandIntAuth) {
-			printf("ECDSA\n");
 			Crypto::ECDSAKey ecdsa_key;
 			err = cryptolib.ECDSAGenKey(key_storage.GetECDSACurveID(File::AppletID::OpenPGP, file_id), ecdsa_key);
 			if (err != Util::Error::NoError)
@@ -206,6 +212,11 @@ Util::Error APDUGenerateAsymmetricKeyPair::Process(uint8_t cla,
 			if (err != Util::Error::NoError)
 				return err;
 
+			// DS-Counter was reset
+			err = security.AfterSaveFileLogic(key_type);
+			if (err != Util::Error::NoError)
+				return err;
+
 			err = key_storage.GetPublicKey7F49(File::AppletID::OpenPGP, key_type, alg.AlgorithmID, dataOut);
 			if (err != Util::Error::NoError)
 				return err;
@@ -215,7 +226,6 @@ Util::Error APDUGenerateAsymmetricKeyPair::Process(uint8_t cla,
 
 		return Util::Error::DataNotFound;
 	} else {
-		printf("GetKey only\n");
 		err = key_storage.GetPublicKey7F49(
 				File::AppletID::OpenPGP,
 				key_type,
@@ -258,7 +268,6 @@ Util::Error APDUPSO::Process(uint8_t cla, uint8_t ins, uint8_t p1,
 	dataOut.clear();
 
 	Factory::SoloFactory &solo = Factory::SoloFactory::GetSoloFactory();
-	File::FileSystem &filesystem = solo.GetFileSystem();
 	Crypto::CryptoEngine &crypto_e = solo.GetCryptoEngine();
 	OpenPGP::OpenPGPFactory &opgp_factory = solo.GetOpenPGPFactory();
 	OpenPGP::Security &security = opgp_factory.GetSecurity();
@@ -267,19 +276,18 @@ Util::Error APDUPSO::Process(uint8_t cla, uint8_t ins, uint8_t p1,
 	if (err_check != Util::Error::NoError)
 		return err_check;
 
-	PWStatusBytes pwstatus;
-	pwstatus.Load(filesystem);
+	PWStatusBytes &pwstatus = security.GetPWStatus();
 
 	//PSO:CDS OpenPGP 3.3.1 page 53. iso 7816-8:2004 page 6-8
 	if (p1 == 0x9e && p2 == 0x9a) {
 		if (!security.GetAuth(OpenPGP::Password::PSOCDS))
 			return Util::Error::AccessDenied;
 
-		OpenPGP::AlgoritmAttr alg;
-		auto err = alg.Load(filesystem, 0xc1); // DigitalSignature
-		if (err != Util::Error::NoError || alg.AlgorithmID == 0)
+		OpenPGP::AlgoritmAttr &alg = *security.GetAlgoritmAttr(0xc1); // DigitalSignature
+		if (alg.AlgorithmID == 0)
 			return Util::Error::DataNotFound;
 
+		Util::Error err;
 		if (alg.AlgorithmID == Crypto::AlgoritmID::RSA)
 			err = crypto_e.RSASign(File::AppletID::OpenPGP, OpenPGPKeyType::DigitalSignature, data, dataOut);
 		else
@@ -303,11 +311,12 @@ Util::Error APDUPSO::Process(uint8_t cla, uint8_t ins, uint8_t p1,
 		if (!security.GetAuth(OpenPGP::Password::PW1))
 			return Util::Error::AccessDenied;
 
-		OpenPGP::AlgoritmAttr alg;
-		auto err = alg.Load(filesystem, 0xc2); // Confidentiality
-		if (err != Util::Error::NoError || alg.AlgorithmID == 0)
+		OpenPGP::AlgoritmAttr &alg = *security.GetAlgoritmAttr(0xc2); // Confidentiality
+		if (alg.AlgorithmID == 0)
 			return Util::Error::DataNotFound;
 
+		Util::Error err = Util::Error::NoError;
+
 		// RSA. OpenPGP 3.3.1 page 59
 		if (data[0] == 0x00) {
 			if (alg.AlgorithmID == Crypto::AlgoritmID::RSA) {
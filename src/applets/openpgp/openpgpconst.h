@@ -62,6 +62,9 @@ public:
 	static const size_t MaxGetChallengeLen = 128U;
 	static const size_t MaxCardholderCertificateLen = 2048U;
 	static const size_t MaxSpecialDOLen = 255U;
+
+	static const uint16_t StatisticsDO = 0x0110;          // vendor. read only, latency histograms
+	static const uint16_t PSOGetResponseDO = 0x0111;      // vendor. 01 - PSO data always via 61xx and GET RESPONSE
 };
 
 enum OpenPGPKeyType {
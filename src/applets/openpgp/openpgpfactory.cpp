@@ -8,20 +8,63 @@
  */
 
 #include <applets/openpgp/openpgpfactory.h>
+#include <iterator>
+#include "applets/apduconst.h"
 #include "solofactory.h"
 
 namespace OpenPGP {
 
-Applet::APDUCommand* OpenPGPFactory::GetAPDUCommand(uint8_t cla,
-		uint8_t ins, uint8_t p1, uint8_t p2) {
+using Applet::APDUcommands;
 
-	for(const auto& cmd: commands) {
-    	if (cmd->Check(cla, ins, p1, p2) == Util::Error::NoError) {
-    		return cmd;
-    	}
-    }
+template <auto Member>
+static Applet::APDUCommand *Handler(OpenPGPFactory &factory) {
+	return &(factory.*Member);
+}
+
+// OpenPGP application v3.3.1 page 35 and 7.2
+static constexpr CommandEntry Commands[] = {
+	// ins, handler, {cla, works in any state, data object check, password, P1 specific passwords}
+	{APDUcommands::Verify,               Handler<&OpenPGPFactory::apduVerify>,                    {CLA00 | CLA0C,         false, DONone,  Password::Any, 0, {}}},
+	{APDUcommands::ChangeReferenceData,  Handler<&OpenPGPFactory::apduChangeReferenceData>,       {CLA00 | CLA0C,         false, DONone,  Password::Any, 0, {}}},
+	{APDUcommands::ResetRetryCounter,    Handler<&OpenPGPFactory::apduResetRetryCounter>,         {CLA00 | CLA0C,         false, DONone,  Password::Any, 0, {}}},
+	{APDUcommands::GetData,              Handler<&OpenPGPFactory::apduGetData>,                   {CLA00 | CLA0C,         false, DORead,  Password::Any, 0, {}}},
+	{APDUcommands::GetData2,             Handler<&OpenPGPFactory::apduGetData>,                   {CLA00 | CLA0C,         false, DORead,  Password::Any, 0, {}}},
+	{APDUcommands::PutData,              Handler<&OpenPGPFactory::apduPutData>,                   {CLA00 | CLA0C | CLA10, false, DOWrite, Password::Any, 0, {}}},
+	{APDUcommands::PutData2,             Handler<&OpenPGPFactory::apduPutData>,                   {CLA00 | CLA0C | CLA10, false, DOWrite, Password::Any, 0, {}}},
+
+	{APDUcommands::GetChallenge,         Handler<&OpenPGPFactory::apduGetChallenge>,              {CLA00,                 false, DONone,  Password::Any, 0, {}}},
+	{APDUcommands::InternalAuthenticate, Handler<&OpenPGPFactory::apduInternalAuthenticate>,      {CLA00,                 false, DONone,  Password::PW1, 0, {}}},
+	{APDUcommands::GenerateAsymmKeyPair, Handler<&OpenPGPFactory::apduGenerateAsymmetricKeyPair>, {CLA00 | CLA0C,         false, DONone,  Password::Any, 1, {{0x80, Password::PW3}}}},  // generation. 0x81 - read public key
+	{APDUcommands::PSO,                  Handler<&OpenPGPFactory::apduPSO>,                       {CLA00,                 false, DONone,  Password::Any, 3, {{0x9e, Password::PSOCDS}, {0x80, Password::PW1}, {0x86, Password::PW1}}}},  // signature, decipher, encipher
+
+	{APDUcommands::ActivateFile,         Handler<&OpenPGPFactory::apduActivateFile>,              {CLA00 | CLA0C,         true,  DONone,  Password::Any, 0, {}}},
+	{APDUcommands::TerminateDF,          Handler<&OpenPGPFactory::apduTerminateDF>,               {CLA00 | CLA0C,         true,  DONone,  Password::Any, 0, {}}},
+	{APDUcommands::ManageSecurityEnv,    Handler<&OpenPGPFactory::apduManageSecurityEnvironment>, {CLA00,                 false, DONone,  Password::Any, 0, {}}},
+	{APDUcommands::SoloReboot,           Handler<&OpenPGPFactory::apduSoloReboot>,                {CLA00,                 true,  DONone,  Password::Any, 0, {}}},
+	{APDUcommands::SoloGetMultipleData,  Handler<&OpenPGPFactory::apduGetMultipleData>,           {CLA00 | CLA0C,         false, DONone,  Password::Any, 0, {}}},  // access of each DO in Process
+};
+
+static constexpr bool CommandsUnique() {
+	for (size_t i = 0; i < std::size(Commands); i++)
+		for (size_t j = i + 1; j < std::size(Commands); j++)
+			if (Commands[i].ins == Commands[j].ins)
+				return false;
+	return true;
+}
+static_assert(CommandsUnique(), "two commands with the same INS");
+
+static constexpr std::array<const CommandEntry *, 256> MakeDispatchTable() {
+	std::array<const CommandEntry *, 256> table{};
+	for (const auto &cmd: Commands)
+		table[cmd.ins] = &cmd;
+	return table;
+}
+
+// INS -> command
+static constexpr std::array<const CommandEntry *, 256> DispatchTable = MakeDispatchTable();
 
-	return nullptr;
+const CommandEntry* OpenPGPFactory::GetCommand(uint8_t ins) {
+	return DispatchTable[ins];
 }
 
 ResetProvider& OpenPGPFactory::GetResetProvider() {
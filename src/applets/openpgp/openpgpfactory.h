@@ -21,6 +21,15 @@
 
 namespace OpenPGP {
 
+	class OpenPGPFactory;
+
+	// command handler and its access rules for one INS
+	struct CommandEntry {
+		uint8_t ins;
+		Applet::APDUCommand *(*handler)(OpenPGPFactory &factory);
+		CommandAccess access;
+	};
+
 	class OpenPGPFactory {
 	public:
 		// userapdu
@@ -29,6 +38,7 @@ namespace OpenPGP {
 		APDUResetRetryCounter apduResetRetryCounter;
 		APDUGetData apduGetData;
 		APDUPutData apduPutData;
+		APDUGetMultipleData apduGetMultipleData;
 
 		// cryptoapdu
 		APDUGetChallenge apduGetChallenge;
@@ -42,28 +52,11 @@ namespace OpenPGP {
 		APDUManageSecurityEnvironment apduManageSecurityEnvironment;
 		APDUSoloReboot apduSoloReboot;
 
-		std::array<Applet::APDUCommand*, 13> commands = {
-			&apduVerify,
-			&apduChangeReferenceData,
-			&apduResetRetryCounter,
-			&apduGetData,
-			&apduPutData,
-
-			&apduGetChallenge,
-			&apduInternalAuthenticate,
-			&apduGenerateAsymmetricKeyPair,
-			&apduPSO,
-
-			&apduActivateFile,
-			&apduTerminateDF,
-			&apduManageSecurityEnvironment,
-			&apduSoloReboot,
-		};
-
 		ResetProvider resetProvider;
 		Security security;
 	public:
-		Applet::APDUCommand *GetAPDUCommand(uint8_t cla, uint8_t ins, uint8_t p1, uint8_t p2);
+		// nullptr if there is no command with this INS
+		const CommandEntry *GetCommand(uint8_t ins);
 
 		Security &GetSecurity();
 		ResetProvider &GetResetProvider();
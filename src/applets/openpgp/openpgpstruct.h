@@ -18,22 +18,17 @@
 
 namespace OpenPGP {
 
+// authentication of one logical channel
 struct AppletState {
 	bool pw1Authenticated = false;
 	bool cdsAuthenticated = false;
 	bool pw3Authenticated = false;
 
-	bool terminateExecuted = false;
-
 	void Clear() {
 		pw1Authenticated = false;
 		cdsAuthenticated = false;
 		pw3Authenticated = false;
 	}
-	void Init() {
-		Clear();
-		terminateExecuted = false;
-	}
 };
 
 struct AppletConfig {
@@ -23,7 +23,7 @@ struct DOAccess_t {
 };
 
 // OpenPGP 3.3.1 page 36
-std::array<DOAccess_t, 49> DOAccess = {{
+std::array<DOAccess_t, 51> DOAccess = {{
 		{0x0101, Password::Any,   Password::PW1},   // Private use
 		{0x0102, Password::Any,   Password::PW3},
 		{0x0103, Password::PW1,   Password::PW1},
@@ -77,6 +77,8 @@ std::array<DOAccess_t, 49> DOAccess = {{
 		{0x7f74, Password::Any,   Password::Never}, // General feature management
 		{0x5f52, Password::Any,   Password::Never}, // Historical bytes
 		{0x4f,   Password::Any,   Password::Never}, // AID
+		{0x0110, Password::Any,   Password::Never}, // Vendor statistics, PGPConst::StatisticsDO
+		{0x0111, Password::Any,   Password::PW3},   // Vendor PSO compatibility, PGPConst::PSOGetResponseDO
 
 		// composed data
 		{0x65,   Password::Any,   Password::PW3},   // 5b, 5f2d, 5f35
@@ -144,14 +146,14 @@ Util::Error OpenPGP::Security::DataObjectInAllowedList(uint16_t dataObjectID) {
 	return Util::Error::AccessDenied;
 }
 
-Util::Error Security::CommandAccessCheck(
-		uint8_t cla, uint8_t ins, uint8_t p1, uint8_t p2) {
+Util::Error Security::CommandAccessCheck(const CommandAccess &access,
+		uint8_t cla, uint8_t p1, uint8_t p2) {
 
-	// check init and terminated card states
-	if (ins != Applet::APDUcommands::ActivateFile &&
-		ins != Applet::APDUcommands::TerminateDF &&
-		ins != Applet::APDUcommands::SoloReboot ) {
+	if (!(access.cla & CLABit(cla)))
+		return Util::Error::WrongAPDUCLA;
 
+	// check init and terminated card states
+	if (!access.anyState) {
 		// check init state
 		LifeCycleState lcstate = LifeCycleState::Init;
 		auto err = GetLifeCycleState(lcstate);
@@ -166,76 +168,23 @@ Util::Error Security::CommandAccessCheck(
 			return Util::Error::ConditionsNotSatisfied;
 	}
 
-
-	// DataObjectAccessCheck
-	if (ins == Applet::APDUcommands::GetData ||
-		ins == Applet::APDUcommands::GetData2 ||
-		ins == Applet::APDUcommands::PutData ||
-		ins == Applet::APDUcommands::PutData2
-		) {
-
+	// GET DATA and PUT DATA
+	if (access.doCheck != DONone) {
 		uint16_t object_id = (p1 << 8) + p2;
 
-		auto err = DataObjectAccessCheck(
-				object_id,
-				ins == Applet::APDUcommands::PutData || ins == Applet::APDUcommands::PutData2);
+		auto err = DataObjectAccessCheck(object_id, access.doCheck == DOWrite);
 		if (err != Util::Error::NoError)
 			return err;
 	}
 
-	// Perform Security Operation
-	if (ins == Applet::APDUcommands::PSO)
-		switch (p1) {
-		// signature
-		case 0x9e:
-			if (GetAuth(Password::PSOCDS)) // PW+81
-				return Util::Error::NoError;
-			else
-				return Util::Error::AccessDenied;
-
-		// decipher
-		case 0x80:
-			if (GetAuth(Password::PW1))   // PW+82
-				return Util::Error::NoError;
-			else
-				return Util::Error::AccessDenied;
-
-		// encipher
-		case 0x86:
-			if (GetAuth(Password::PW1))   // PW+82
-				return Util::Error::NoError;
-			else
-				return Util::Error::AccessDenied;
-		default:
-			break;
-		};
-
-	// Internal authenticate
-	if (ins == Applet::APDUcommands::InternalAuthenticate) {
-		if (GetAuth(Password::PW1)) {
-			return Util::Error::NoError;
-		} else {
-			return Util::Error::AccessDenied;
-		}
-	}
-
-	// Generate asymmetric key pair
-	if (ins == Applet::APDUcommands::GenerateAsymmKeyPair)
-		switch (p1) {
-		// 0x80 - Generation of key pair
-		case 0x80:
-			if (GetAuth(Password::PW3))
-				return Util::Error::NoError;
-			else
-				return Util::Error::AccessDenied;
-
-		// 0x81 - Reading of actual public key template
-		case 0x81:
-			return Util::Error::NoError;
+	// PSO and generate key pair needs different passwords for different P1
+	Password passwd = access.passwd;
+	for (uint8_t i = 0; i < access.p1count; i++)
+		if (access.p1passwd[i].p1 == p1)
+			passwd = access.p1passwd[i].passwd;
 
-		default:
-			break;
-		};
+	if (!GetAuth(passwd))
+		return Util::Error::AccessDenied;
 
 	return Util::Error::NoError;
 }
@@ -248,8 +197,19 @@ bool Security::DataObjectInSecureArea(uint16_t dataObjectID) {
 }
 
 
+void Security::SetChannel(uint8_t channelNum) {
+	if (channelNum < Applet::LogicalChannelCount)
+		channel = channelNum;
+}
+
 void Security::ClearAllAuth() {
-	appletState.Clear();
+	for (auto &state: appletState)
+		state.Clear();
+}
+
+void Security::ClearChannelAuth(uint8_t channelNum) {
+	if (channelNum < Applet::LogicalChannelCount)
+		appletState[channelNum].Clear();
 }
 
 void Security::Init() {
@@ -268,10 +228,68 @@ void Security::Reload() {
 
 	pwstatus.Load(filesystem);
 	kdfDO.Load(filesystem);
+	for (KeyID_t id = 0xc1; id <= 0xc3; id++)
+		LoadAlgoritmAttr(id);
+	LoadDSCounter();
+	LoadPSOGetResponse();
+}
+
+void Security::LoadAlgoritmAttr(KeyID_t fileID) {
+	Factory::SoloFactory &solo = Factory::SoloFactory::GetSoloFactory();
+	File::FileSystem &filesystem = solo.GetFileSystem();
+
+	AlgoritmAttr *alg = GetAlgoritmAttr(fileID);
+	if (alg == nullptr)
+		return;
+
+	alg->Clear();
+	if (alg->Load(filesystem, fileID) != Util::Error::NoError)
+		alg->Clear();
+}
+
+void Security::LoadDSCounter() {
+	Factory::SoloFactory &solo = Factory::SoloFactory::GetSoloFactory();
+	File::FileSystem &filesystem = solo.GetFileSystem();
+
+	dsCounterLoaded = (dsCounter.Load(filesystem) == Util::Error::NoError);
+}
+
+void Security::LoadPSOGetResponse() {
+	Factory::SoloFactory &solo = Factory::SoloFactory::GetSoloFactory();
+	File::FileSystem &filesystem = solo.GetFileSystem();
+
+	uint8_t _data[1] = {0};
+	bstr data{_data, 0, sizeof(_data)};
+	auto err = filesystem.ReadFile(File::AppletID::OpenPGP, PGPConst::PSOGetResponseDO, File::File, data);
+	psoGetResponse = (err == Util::Error::NoError && data.length() == 1 && data[0] == 0x01);
+}
+
+bool Security::PSOGetResponse() {
+	return psoGetResponse;
+}
+
+PWStatusBytes& Security::GetPWStatus() {
+	return pwstatus;
+}
+
+AlgoritmAttr* Security::GetAlgoritmAttr(KeyID_t fileID) {
+	switch (fileID) {
+	case 0xc1:
+	case OpenPGPKeyType::DigitalSignature:
+		return &algAttr[0];
+	case 0xc2:
+	case OpenPGPKeyType::Confidentiality:
+		return &algAttr[1];
+	case 0xc3:
+	case OpenPGPKeyType::Authentication:
+		return &algAttr[2];
+	default:
+		return nullptr;
+	}
 }
 
 void Security::intRESET() {
-	appletState.Init();  // clear `terminateExecuted` state
+	terminateExecuted = false;
 	Init();
 }
 
@@ -279,10 +297,30 @@ Util::Error Security::AfterSaveFileLogic(uint16_t objectID) {
 	Factory::SoloFactory &solo = Factory::SoloFactory::GetSoloFactory();
 	File::FileSystem &filesystem = solo.GetFileSystem();
 
-	// PW status and KDF-DO
-	// list of objects that need to refresh theirs state
-	if (objectID == 0xc4 || objectID == 0xf9)
-		Reload();
+	// refresh the resident state of the object
+	switch (objectID) {
+	case 0xc4:
+		pwstatus.Load(filesystem);
+		break;
+	case 0xf9:
+		kdfDO.Load(filesystem);
+		break;
+	case 0xc1:
+	case 0xc2:
+	case 0xc3:
+		LoadAlgoritmAttr(objectID);
+		break;
+	// key import and generation reset DS-Counter
+	case 0x3fff:
+	case OpenPGPKeyType::DigitalSignature:
+		LoadDSCounter();
+		break;
+	case PGPConst::PSOGetResponseDO:
+		LoadPSOGetResponse();
+		break;
+	default:
+		break;
+	}
 
 	// reset reseting password code try TODO: check in the datasheet if it correct!
 	if (objectID == 0xd3) {
@@ -518,13 +556,13 @@ Util::Error Security::ClearAllPasswd() {
 void Security::ClearAuth(Password passwdId) {
 	switch (passwdId){
 	case Password::PW1:
-		appletState.pw1Authenticated = false;
+		appletState[channel].pw1Authenticated = false;
 		break;
 	case Password::PW3:
-		appletState.pw3Authenticated = false;
+		appletState[channel].pw3Authenticated = false;
 		break;
 	case Password::PSOCDS:
-		appletState.cdsAuthenticated = false;
+		appletState[channel].cdsAuthenticated = false;
 		break;
 	default:
 		break;
@@ -534,13 +572,13 @@ void Security::ClearAuth(Password passwdId) {
 void Security::SetAuth(Password passwdId) {
 	switch (passwdId){
 	case Password::PW1:
-		appletState.pw1Authenticated = true;
+		appletState[channel].pw1Authenticated = true;
 		break;
 	case Password::PW3:
-		appletState.pw3Authenticated = true;
+		appletState[channel].pw3Authenticated = true;
 		break;
 	case Password::PSOCDS:
-		appletState.cdsAuthenticated = true;
+		appletState[channel].cdsAuthenticated = true;
 		break;
 	default:
 		break;
@@ -550,11 +588,11 @@ void Security::SetAuth(Password passwdId) {
 bool Security::GetAuth(Password passwdId) {
 	switch (passwdId){
 	case Password::PW1:
-		return appletState.pw1Authenticated;
+		return appletState[channel].pw1Authenticated;
 	case Password::PW3:
-		return appletState.pw3Authenticated;
+		return appletState[channel].pw3Authenticated;
 	case Password::PSOCDS:
-		return appletState.cdsAuthenticated;
+		return appletState[channel].cdsAuthenticated;
 	case Password::Any:
 		return true;
 	case Password::Never:
@@ -568,26 +606,30 @@ Util::Error Security::IncDSCounter() {
 	Factory::SoloFactory &solo = Factory::SoloFactory::GetSoloFactory();
 	File::FileSystem &filesystem = solo.GetFileSystem();
 
-	DSCounter dscounter;
-	auto cntrerr = dscounter.Load(filesystem);
-	if (cntrerr != Util::Error::NoError)
-		return cntrerr;
+	if (!dsCounterLoaded) {
+		auto cntrerr = dsCounter.Load(filesystem);
+		if (cntrerr != Util::Error::NoError)
+			return cntrerr;
+		dsCounterLoaded = true;
+	}
 
-	dscounter.Counter++;
+	dsCounter.Counter++;
 
-	cntrerr = dscounter.Save(filesystem);
-	if (cntrerr != Util::Error::NoError)
+	auto cntrerr = dsCounter.Save(filesystem);
+	if (cntrerr != Util::Error::NoError) {
+		dsCounterLoaded = false;
 		return cntrerr;
+	}
 
 	return Util::Error::NoError;
 }
 
 void Security::Terminate() {
-	appletState.terminateExecuted = true;
+	terminateExecuted = true;
 }
 
 bool Security::isTerminated() {
-	return appletState.terminateExecuted;
+	return terminateExecuted;
 }
 
 } /* namespace OpenPGP */
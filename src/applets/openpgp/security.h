@@ -16,21 +16,78 @@
 #include "util.h"
 #include "openpgpconst.h"
 #include "openpgpstruct.h"
+#include "applets/apduconst.h"
 
 namespace OpenPGP {
 
+	// allowed CLA of the command
+	enum CLAMask : uint8_t {
+		CLA00 = 0x01,
+		CLA0C = 0x02,
+		CLA10 = 0x04,  // command chaining
+	};
+
+	constexpr uint8_t CLABit(uint8_t cla) {
+		switch (cla) {
+		case 0x00: return CLA00;
+		case 0x0c: return CLA0C;
+		case 0x10: return CLA10;
+		default:   return 0;
+		}
+	}
+
+	// P1P2 is a data object id and its access rule is checked
+	enum DOCheck : uint8_t {
+		DONone,
+		DORead,
+		DOWrite,
+	};
+
+	struct P1Passwd {
+		uint8_t p1;
+		Password passwd;
+	};
+
+	// access rules of one command. OpenPGP application v3.3.1 page 35
+	struct CommandAccess {
+		uint8_t cla;              // CLAMask
+		bool anyState;            // works in init and terminated states
+		DOCheck doCheck;
+		Password passwd;          // for P1 that are not in p1passwd
+		uint8_t p1count;
+		P1Passwd p1passwd[3];
+	};
+
 	// OpenPGP application v3.3.1 page 35
 	class Security {
 	private:
-		AppletState appletState;
+		AppletState appletState[Applet::LogicalChannelCount];
+		uint8_t channel = 0;  // of the current command
+		bool terminateExecuted = false;
+
+		// resident state: loaded in Init, updated in AfterSaveFileLogic and on save
 		AppletConfig appletConfig;
 		PWStatusBytes pwstatus;
 		KDFDO kdfDO;
+		AlgoritmAttr algAttr[3];  // c1 - c3
+		DSCounter dsCounter;
+		bool dsCounterLoaded = false;
+		bool psoGetResponse = false;
+
+		void LoadAlgoritmAttr(KeyID_t fileID);
+		void LoadDSCounter();
+		void LoadPSOGetResponse();
 	public:
 		void Init();
 		void Reload();
 		Util::Error AfterSaveFileLogic(uint16_t objectID);
 
+		PWStatusBytes &GetPWStatus();
+		// c1 - c3 and key types. AlgorithmID == 0 if not loaded. nullptr for other ids
+		AlgoritmAttr *GetAlgoritmAttr(KeyID_t fileID);
+		// compatibility for the hosts that expect 61xx after PSO. default - data in the response
+		bool PSOGetResponse();
+
 		Util::Error GetLifeCycleState(LifeCycleState &state);
 		Util::Error SetLifeCycleState(LifeCycleState state);
 
@@ -42,7 +99,10 @@ namespace OpenPGP {
 		uint8_t PasswdTryRemains(Password passwdId);
 		Util::Error ClearAllPasswd();
 
+		// auth functions work with the state of this channel
+		void SetChannel(uint8_t channelNum);
 		void ClearAllAuth();
+		void ClearChannelAuth(uint8_t channelNum);
 
 		void ClearAuth(Password passwdId);
 		void SetAuth(Password passwdId);
@@ -50,7 +110,7 @@ namespace OpenPGP {
 
 		Util::Error IncDSCounter();
 
-		Util::Error CommandAccessCheck(uint8_t cla, uint8_t ins, uint8_t p1, uint8_t p2);
+		Util::Error CommandAccessCheck(const CommandAccess &access, uint8_t cla, uint8_t p1, uint8_t p2);
 		Util::Error DataObjectAccessCheck(uint16_t dataObjectID, bool writeAccess);
 		Util::Error DataObjectInAllowedList(uint16_t dataObjectID);
 		bool DataObjectInSecureArea(uint16_t dataObjectID);
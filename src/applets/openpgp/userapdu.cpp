@@ -16,6 +16,7 @@
 #include "openpgpconst.h"
 #include "openpgpstruct.h"
 #include "filesystem.h"
+#include "trace.h"
 
 namespace OpenPGP {
 
@@ -209,7 +210,7 @@ Util::Error APDUGetData::Process(uint8_t cla, uint8_t ins, uint8_t p1,
 		return err_check;
 
 	uint16_t object_id = (p1 << 8) + p2;
-	printf("read object id = 0x%04x\n", object_id);
+	TRACE_DEBUG(Trace::DataRead, object_id);
 
 	filesystem.ReadFile(File::AppletID::OpenPGP, object_id, File::File, dataOut);
 
@@ -221,6 +222,80 @@ std::string_view APDUGetData::GetName() {
 	return "GetData"sv;
 }
 
+Util::Error APDUGetMultipleData::Check(uint8_t cla, uint8_t ins, uint8_t p1, uint8_t p2) {
+	if (ins != Applet::APDUcommands::SoloGetMultipleData)
+		return Util::Error::WrongCommand;
+
+	if (cla != 0x00 && cla != 0x0c)
+		return Util::Error::WrongAPDUCLA;
+
+	if (p1 != 0x00 || p2 != 0x00)
+		return Util::Error::WrongAPDUP1P2;
+
+	return Util::Error::NoError;
+}
+
+// one APDU instead of a GET DATA for each DO.
+// response: tag(2, as P1P2 of GET DATA) + BER length + value for each tag in the request order.
+// DOs without read access are skipped, absent DOs are empty as in GET DATA.
+// OutOfMemory (6A84) if the response buffer can't hold all the DOs.
+Util::Error APDUGetMultipleData::Process(uint8_t cla, uint8_t ins, uint8_t p1,
+		uint8_t p2, bstr data, uint8_t le, bstr &dataOut) {
+
+	dataOut.clear();
+
+	auto err_check = Check(cla, ins, p1, p2);
+	if (err_check != Util::Error::NoError)
+		return err_check;
+
+	if (data.length() == 0 || data.length() % 2)
+		return Util::Error::WrongAPDUDataLength;
+
+	Factory::SoloFactory &solo = Factory::SoloFactory::GetSoloFactory();
+	File::FileSystem &filesystem = solo.GetFileSystem();
+	Security &security = solo.GetOpenPGPFactory().GetSecurity();
+
+	// tag and the longest length header
+	constexpr size_t MaxHeaderLength = 2 + 3;
+
+	for (size_t i = 0; i < data.length(); i += 2) {
+		uint16_t object_id = (data[i] << 8) + data[i + 1];
+		if (security.DataObjectAccessCheck(object_id, false) != Util::Error::NoError)
+			continue;
+
+		if (dataOut.free_space() < MaxHeaderLength)
+			return Util::Error::OutOfMemory;
+
+		// read after the header space, then move the value to the real header length
+		uint8_t *value = dataOut.uint8Data() + dataOut.length() + MaxHeaderLength;
+		bstr vdata(value, 0, dataOut.free_space() - MaxHeaderLength);
+		auto err = filesystem.ReadFile(File::AppletID::OpenPGP, object_id, File::File, vdata);
+		if (err == Util::Error::FileNotFound)
+			vdata.clear();
+		else if (err != Util::Error::NoError)
+			return err;
+		// the storage cuts the file at the end of the buffer, a full buffer may be a part of the DO
+		else if (vdata.length() >= vdata.max_length())
+			return Util::Error::OutOfMemory;
+		if (vdata.length() > 0xffff)
+			return Util::Error::OutOfMemory;
+
+		size_t size = 0;
+		dataOut.append(object_id >> 8);
+		dataOut.append(object_id & 0xff);
+		Util::EncodeLength(dataOut, size, vdata.length());
+		memmove(dataOut.uint8Data() + dataOut.length(), value, vdata.length());
+		dataOut.set_length(dataOut.length() + vdata.length());
+	}
+
+	return Util::Error::NoError;
+}
+
+std::string_view APDUGetMultipleData::GetName() {
+	using namespace std::literals;
+	return "GetMultipleData"sv;
+}
+
 Util::Error APDUPutData::Check(uint8_t cla, uint8_t ins, uint8_t p1, uint8_t p2) {
 	if (ins != Applet::APDUcommands::PutData && ins != Applet::APDUcommands::PutData2)
 		return Util::Error::WrongCommand;
@@ -251,7 +326,7 @@ Util::Error APDUPutData::Process(uint8_t cla, uint8_t ins, uint8_t p1,
 
 	if (ins == Applet::APDUcommands::PutData) {
 		uint16_t object_id = (p1 << 8) + p2;
-		printf("write object id = 0x%04x\n", object_id);
+		TRACE_DEBUG(Trace::DataWrite, object_id, nullptr, data.length());
 
 		if (OpenPGP::PGPConst::ReadWriteOnlyAllowedFiles) {
 			err_check = security.DataObjectInAllowedList(object_id);
@@ -284,6 +359,11 @@ Util::Error APDUPutData::Process(uint8_t cla, uint8_t ins, uint8_t p1,
 
 		}
 
+		// 00 or 01
+		if (object_id == PGPConst::PSOGetResponseDO &&
+			(data.length() != 1 || data[0] > 0x01))
+			return Util::Error::WrongData;
+
 		// check AES key correct length
 		if (object_id == 0xd5 &&
 			data.length() != 16 && data.length() != 24 && data.length() != 32)
@@ -299,8 +379,13 @@ Util::Error APDUPutData::Process(uint8_t cla, uint8_t ins, uint8_t p1,
 		if (err != Util::Error::NoError)
 			return err;
 	} else {
-		printf("write KeyExtHeader\n");
+		TRACE_DEBUG(Trace::KeyImport, 0, nullptr, data.length());
 		key_storage.SetKeyExtHeader(File::AppletID::OpenPGP, data);
+
+		// key import resets DS-Counter
+		auto err = security.AfterSaveFileLogic(0x3fff);
+		if (err != Util::Error::NoError)
+			return err;
 	}
 
 	return Util::Error::NoError;
@@ -45,6 +45,14 @@ namespace OpenPGP {
 		virtual std::string_view GetName();
 	};
 
+	// vendor. data: list of DO tags, 2 bytes each. see Process
+	class APDUGetMultipleData : public Applet::APDUCommand {
+	public:
+		virtual Util::Error Check(uint8_t cla, uint8_t ins, uint8_t p1, uint8_t p2);
+		virtual Util::Error Process(uint8_t cla, uint8_t ins, uint8_t p1, uint8_t p2, bstr data, uint8_t le, bstr &dataOut);
+		virtual std::string_view GetName();
+	};
+
 	class APDUPutData : public Applet::APDUCommand {
 	public:
 		virtual Util::Error Check(uint8_t cla, uint8_t ins, uint8_t p1, uint8_t p2);
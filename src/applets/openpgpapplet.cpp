@@ -14,22 +14,19 @@
 
 namespace Applet {
 
+// security state is loaded in SoloFactory::Init. here the factory may be not constructed yet.
 OpenPGPApplet::OpenPGPApplet() : Applet() {
-	Factory::SoloFactory &solo = Factory::SoloFactory::GetSoloFactory();
-	OpenPGP::OpenPGPFactory &opgp_factory = solo.GetOpenPGPFactory();
-	OpenPGP::Security &security = opgp_factory.GetSecurity();
-
-	security.Init();
 }
 
-Util::Error OpenPGPApplet::Select(bstr &result) {
-	auto err = Applet::Select(result);
+// state is already in memory, select resets only the authentication of this channel
+Util::Error OpenPGPApplet::Select(uint8_t channel, bstr &result) {
+	auto err = Applet::Select(channel, result);
 
 	Factory::SoloFactory &solo = Factory::SoloFactory::GetSoloFactory();
 	OpenPGP::OpenPGPFactory &opgp_factory = solo.GetOpenPGPFactory();
 	OpenPGP::Security &security = opgp_factory.GetSecurity();
 
-	security.Init();
+	security.ClearChannelAuth(channel);
 
 	using namespace OpenPGP;
     LifeCycleState lcstate = LifeCycleState::Init;
@@ -43,6 +40,21 @@ Util::Error OpenPGPApplet::Select(bstr &result) {
 	return err;
 }
 
+Util::Error OpenPGPApplet::DeSelect(uint8_t channel) {
+	Factory::SoloFactory &solo = Factory::SoloFactory::GetSoloFactory();
+	solo.GetOpenPGPFactory().GetSecurity().ClearChannelAuth(channel);
+
+	return Applet::DeSelect(channel);
+}
+
+bool OpenPGPApplet::ForceGetResponse(APDUStruct &apdu) {
+	if (apdu.ins != APDUcommands::PSO)
+		return false;
+
+	Factory::SoloFactory &solo = Factory::SoloFactory::GetSoloFactory();
+	return solo.GetOpenPGPFactory().GetSecurity().PSOGetResponse();
+}
+
 const bstr* OpenPGPApplet::GetAID() {
 	return &aid;
 }
@@ -50,26 +62,27 @@ const bstr* OpenPGPApplet::GetAID() {
 Util::Error OpenPGPApplet::APDUExchange(APDUStruct &apdu, bstr &result) {
 	result.clear();
 
-	if (!selected)
+	if (!Selected(apdu.channel))
 		return Util::Error::AppletNotSelected;
 
 	Factory::SoloFactory &solo = Factory::SoloFactory::GetSoloFactory();
 	OpenPGP::OpenPGPFactory &opgp_factory = solo.GetOpenPGPFactory();
 	OpenPGP::Security &security = opgp_factory.GetSecurity();
+	security.SetChannel(apdu.channel);
+
 
+	auto entry = opgp_factory.GetCommand(apdu.ins);
+	if (!entry)
+		return Util::Error::WrongAPDUINS;
 
-	auto err = security.CommandAccessCheck(apdu.cla, apdu.ins, apdu.p1, apdu.p2);
+	auto err = security.CommandAccessCheck(entry->access, apdu.cla, apdu.p1, apdu.p2);
 	if (err != Util::Error::NoError) {
-		printf("Security error. Access denied.\n");
+		TRACE_ERROR(Trace::AccessDenied, apdu.ins);
 		return err;
 	}
 
-	auto cmd = opgp_factory.GetAPDUCommand(apdu.cla, apdu.ins, apdu.p1, apdu.p2);
-	if (!cmd)
-		return Util::Error::WrongCommand;
-
-	auto name = cmd->GetName();
-	printf("======== %.*s\n", static_cast<int>(name.size()), name.data());
+	auto cmd = entry->handler(opgp_factory);
+	TRACE_INFO(Trace::Command, apdu.ins, cmd->GetName());
 
 	auto cmderr = cmd->Process(apdu.cla, apdu.ins, apdu.p1, apdu.p2, apdu.data, apdu.le, result);
 	if (cmderr != Util::Error::NoError)
@@ -32,7 +32,9 @@ public:
 	virtual const bstr *GetAID();
 
 	virtual Util::Error APDUExchange(APDUStruct &apdu, bstr &result);
-	virtual Util::Error Select(bstr &result);
+	virtual bool ForceGetResponse(APDUStruct &apdu);
+	virtual Util::Error Select(uint8_t channel, bstr &result);
+	virtual Util::Error DeSelect(uint8_t channel);
 };
 
 } // namespace Applet
@@ -7,13 +7,145 @@
   copied, modified, or distributed except according to those terms.
  */
 
+#include <chrono>
+#include <thread>
 #include "testapplet.h"
+#include "solofactory.h"
+#include "stats.h"
 
-const bstr* Applet::TestApplet::GetAID() {
+namespace Applet {
+
+// only the time matters, not the key
+static const bstr TestAESKey = "\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"_bstr;
+
+const bstr* TestApplet::GetAID() {
 	return &aid;
 }
 
-Util::Error Applet::TestApplet::APDUExchange(APDUStruct &apdu, bstr &result) {
-	result.set(apdu.data);
+void TestApplet::CopyKeyPart(bstr &keypart) {
+	size_t pos = testKeyBuffer.length();
+	testKeyBuffer.append(keypart);
+	keypart = bstr(testKeyBuffer.uint8Data() + pos, keypart.length());
+}
+
+Util::Error TestApplet::GenerateTestKeys() {
+	if (testKeysReady)
+		return Util::Error::NoError;
+
+	Crypto::CryptoLib &cryptoLib = Factory::SoloFactory::GetSoloFactory().GetCryptoLib();
+	testKeyBuffer.clear();
+
+	auto err = cryptoLib.RSAGenKey(testRSAKey, 2048);
+	if (err != Util::Error::NoError)
+		return err;
+	CopyKeyPart(testRSAKey.Exp);
+	CopyKeyPart(testRSAKey.P);
+	CopyKeyPart(testRSAKey.Q);
+	CopyKeyPart(testRSAKey.N);
+
+	err = cryptoLib.ECDSAGenKey(Crypto::ECDSAaid::ansix9p256r1, testECDSAKey);
+	if (err != Util::Error::NoError)
+		return err;
+	CopyKeyPart(testECDSAKey.Private);
+	CopyKeyPart(testECDSAKey.Public);
+
+	testKeysReady = true;
 	return Util::Error::NoError;
 }
+
+// GenerateRandom: P2 bytes (00 - 256). AESEncrypt, AESDecrypt: data, 16 bytes blocks.
+// RSAGenKey: P2 * 256 bits key, P2 08, 0c or 10 (2048, 3072, 4096). ECDSAGenKey: P2 - Crypto::ECDSAaid, response - public key.
+// the rest use the test keys (RSA 2048, ansix9p256r1, e = 65537), the first of them generates the keys.
+// RSACalcPublicKey, ECDSACalcPublicKey: response - public key of the test key (n, 04 x y).
+// RSASign: data - digest info. RSADecipher: data - PKCS#1 v1.5 cryptogram for n.
+// ECDSASign: data - digest. ECDHComputeShared: data - public key, empty - the test public key.
+Util::Error TestApplet::RunCrypto(uint8_t op, uint8_t param, bstr data, bstr &result) {
+	Factory::SoloFactory &solo = Factory::SoloFactory::GetSoloFactory();
+	Crypto::CryptoLib &cryptoLib = solo.GetCryptoLib();
+
+	switch (op) {
+	case Stats::GenerateRandom:
+		return cryptoLib.GenerateRandom(param ? param : 0x100, result);
+	case Stats::AESEncrypt:
+		return cryptoLib.AESEncrypt(TestAESKey, data, result);
+	case Stats::AESDecrypt:
+		return cryptoLib.AESDecrypt(TestAESKey, data, result);
+	case Stats::RSAGenKey: {
+		if (param != 8 && param != 12 && param != 16)
+			return Util::Error::WrongAPDUP1P2;
+		Crypto::RSAKey key;
+		return cryptoLib.RSAGenKey(key, param * 256);
+	}
+	case Stats::ECDSAGenKey: {
+		if (param == Crypto::ECDSAaid::none || param > Crypto::ECDSAaid::secp256k1)
+			return Util::Error::WrongAPDUP1P2;
+		Crypto::ECDSAKey key;
+		auto err = cryptoLib.ECDSAGenKey(static_cast<Crypto::ECDSAaid>(param), key);
+		if (err != Util::Error::NoError)
+			return err;
+		result.set(key.Public);
+		return Util::Error::NoError;
+	}
+	case Stats::RSACalcPublicKey:
+	case Stats::RSASign:
+	case Stats::RSADecipher:
+	case Stats::ECDSACalcPublicKey:
+	case Stats::ECDSASign:
+	case Stats::ECDHComputeShared: {
+		auto err = GenerateTestKeys();
+		if (err != Util::Error::NoError)
+			return err;
+
+		switch (op) {
+		case Stats::RSACalcPublicKey:
+			return cryptoLib.RSACalcPublicKey(testRSAKey.P, testRSAKey.Q, result);
+		case Stats::RSASign:
+			return cryptoLib.RSASign(testRSAKey, data, result);
+		case Stats::RSADecipher:
+			return cryptoLib.RSADecipher(testRSAKey, data, result);
+		case Stats::ECDSACalcPublicKey:
+			return cryptoLib.ECDSACalcPublicKey(testECDSAKey.CurveId, testECDSAKey.Private, result);
+		case Stats::ECDSASign:
+			return cryptoLib.ECDSASign(testECDSAKey, data, result);
+		default:
+			return cryptoLib.ECDHComputeShared(testECDSAKey, data.length() ? data : testECDSAKey.Public, result);
+		}
+	}
+	default:
+		return Util::Error::WrongAPDUP1P2;
+	}
+}
+
+Util::Error TestApplet::APDUExchange(APDUStruct &apdu, bstr &result) {
+	result.clear();
+
+	if (!Selected(apdu.channel))
+		return Util::Error::AppletNotSelected;
+
+	if (apdu.cla != 0x00)
+		return Util::Error::WrongAPDUCLA;
+
+	size_t n = (apdu.p1 << 8) + apdu.p2;
+	switch (apdu.ins) {
+	case TestEcho:
+		result.set(apdu.data);
+		return Util::Error::NoError;
+
+	case TestReturn:
+		for (size_t i = 0; i < n; i++)
+			result.append(i & 0xff);
+		return Util::Error::NoError;
+
+	case TestSleep:
+		std::this_thread::sleep_for(std::chrono::microseconds(n));
+		return Util::Error::NoError;
+
+	case TestCrypto:
+		return RunCrypto(apdu.p1, apdu.p2, apdu.data, result);
+
+	default:
+		return Util::Error::WrongAPDUINS;
+	}
+}
+
+}
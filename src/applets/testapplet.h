@@ -11,12 +11,35 @@
 #define SRC_APPLETS_TESTAPPLET_H_
 
 #include "applet.h"
+#include "cryptolib.h"
 
 namespace Applet {
 
+	// benchmark commands, CLA 00. N = P1P2
+	enum TestCommands : uint8_t {
+		TestEcho   = 0x01,  // response - data of the command
+		TestReturn = 0x02,  // response - N bytes 00 01 02 ...
+		TestSleep  = 0x03,  // sleep N us, the card stays locked
+		TestCrypto = 0x04,  // P1 - Stats::CryptoOp, P2 - its parameter. see RunCrypto
+	};
+
+	// loopback applet: transport and executor costs without crypto, and one
+	// crypto primitive without the OpenPGP logic around it
 	class TestApplet: public Applet {
 	private:
 		const bstr aid = "\xfa\xfa\xfa\xfa"_bstr;
+
+		// RSA 2048 and ansix9p256r1 keys for the sign/decipher/ecdh commands.
+		// generated on the first use, CryptoLib reuses its own key buffer
+		bool testKeysReady = false;
+		uint8_t _testKeyBuffer[4 + 128 + 128 + 256 + 32 + 65];
+		bstr testKeyBuffer{_testKeyBuffer, 0, sizeof(_testKeyBuffer)};
+		Crypto::RSAKey testRSAKey;
+		Crypto::ECDSAKey testECDSAKey;
+
+		void CopyKeyPart(bstr &keypart);
+		Util::Error GenerateTestKeys();
+		Util::Error RunCrypto(uint8_t op, uint8_t param, bstr data, bstr &result);
 	public:
 		virtual const bstr *GetAID();
 
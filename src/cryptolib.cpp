@@ -22,6 +22,8 @@
 #include <stdlib.h>
 
 #include "tlv.h"
+#include "trace.h"
+#include "stats.h"
 #include "solofactory.h"
 #include "filesystem.h"
 #include "applets/openpgp/openpgpconst.h"
@@ -37,6 +39,7 @@ void CryptoLib::ClearKeyBuffer() {
 
 
 Util::Error CryptoLib::GenerateRandom(size_t length, bstr& dataOut) {
+	Stats::Timer timer(Stats::Crypto, Stats::GenerateRandom);
 	if (length > dataOut.max_size())
 		return Util::Error::OutOfMemory;
 
@@ -56,6 +59,7 @@ Util::Error CryptoLib::GenerateRandom(size_t length, bstr& dataOut) {
 
 Util::Error CryptoLib::AESEncrypt(bstr key, bstr dataIn,
 		bstr& dataOut) {
+	Stats::Timer timer(Stats::Crypto, Stats::AESEncrypt);
 	dataOut.clear();
 	uint8_t iv[64] = {0};
 
@@ -73,6 +77,7 @@ Util::Error CryptoLib::AESEncrypt(bstr key, bstr dataIn,
 
 Util::Error CryptoLib::AESDecrypt(bstr key, bstr dataIn,
 		bstr& dataOut) {
+	Stats::Timer timer(Stats::Crypto, Stats::AESDecrypt);
 	dataOut.clear();
 	uint8_t iv[64] = {0};
 
@@ -118,6 +123,7 @@ Util::Error CryptoLib::AppendKeyPartEcpPoint(bstr &buffer, bstr &keypart,  mbedt
 }
 
 Util::Error CryptoLib::RSAGenKey(RSAKey& keyOut, size_t keySize) {
+	Stats::Timer timer(Stats::Crypto, Stats::RSAGenKey);
 
 	Util::Error ret = Util::Error::NoError;
 	ClearKeyBuffer();
@@ -249,6 +255,7 @@ Util::Error CryptoLib::RSAFillPrivateKey(mbedtls_rsa_context *context,
 }
 
 Util::Error CryptoLib::RSASign(RSAKey key, bstr data, bstr& signature) {
+	Stats::Timer timer(Stats::Crypto, Stats::RSASign);
 
 	Util::Error ret = Util::Error::NoError;
 
@@ -301,6 +308,7 @@ Util::Error CryptoLib::RSASign(RSAKey key, bstr data, bstr& signature) {
 }
 
 Util::Error CryptoLib::RSADecipher(RSAKey key, bstr data, bstr &dataOut) {
+	Stats::Timer timer(Stats::Crypto, Stats::RSADecipher);
 	Util::Error ret = Util::Error::NoError;
 
 	if (key.P.length() == 0 ||
@@ -363,6 +371,7 @@ Util::Error CryptoLib::RSADecipher(RSAKey key, bstr data, bstr &dataOut) {
 }
 
 Util::Error CryptoLib::RSAVerify(bstr publicKey, bstr data, bstr signature) {
+	Stats::Timer timer(Stats::Crypto, Stats::RSAVerify);
 	return Util::Error::InternalError;
 }
 
@@ -394,6 +403,7 @@ static int ecdsa_init(mbedtls_ecdsa_context *ctx, mbedtls_ecp_group_id curveID,
 };
 
 Util::Error CryptoLib::ECDSAGenKey(ECDSAaid curveID, ECDSAKey& keyOut) {
+	Stats::Timer timer(Stats::Crypto, Stats::ECDSAGenKey);
 	ClearKeyBuffer();
 	keyOut.clear();
 
@@ -445,6 +455,7 @@ Util::Error CryptoLib::ECDSAGenKey(ECDSAaid curveID, ECDSAKey& keyOut) {
 }
 
 Util::Error CryptoLib::ECDSASign(ECDSAKey key, bstr data, bstr& signature) {
+	Stats::Timer timer(Stats::Crypto, Stats::ECDSASign);
 	signature.clear();
 
 	mbedtls_mpi r, s;
@@ -527,6 +538,7 @@ Util::Error CryptoLib::ECDSASign(ECDSAKey key, bstr data, bstr& signature) {
 }
 
 Util::Error CryptoLib::RSACalcPublicKey(bstr strP, bstr strQ, bstr &strN) {
+	Stats::Timer timer(Stats::Crypto, Stats::RSACalcPublicKey);
 	Util::Error ret = Util::Error::NoError;
 
 	mbedtls_rsa_context rsa;
@@ -571,6 +583,7 @@ Util::Error CryptoLib::RSACalcPublicKey(bstr strP, bstr strQ, bstr &strN) {
 }
 
 Util::Error CryptoLib::ECDSACalcPublicKey(ECDSAaid curveID, bstr privateKey, bstr &publicKey) {
+	Stats::Timer timer(Stats::Crypto, Stats::ECDSACalcPublicKey);
 	Util::Error ret = Util::Error::NoError;
 
 	mbedtls_ecdsa_context ctx;
@@ -627,10 +640,12 @@ Util::Error CryptoLib::ECDSACalcPublicKey(ECDSAaid curveID, bstr privateKey, bst
 
 Util::Error CryptoLib::ECDSAVerify(ECDSAKey key, bstr data,
 		bstr signature) {
+	Stats::Timer timer(Stats::Crypto, Stats::ECDSAVerify);
 	return Util::Error::InternalError;
 }
 
 Util::Error CryptoLib::ECDHComputeShared(ECDSAKey key, bstr anotherPublicKey, bstr &sharedSecret) {
+	Stats::Timer timer(Stats::Crypto, Stats::ECDHComputeShared);
 
 	sharedSecret.clear();
 
@@ -737,27 +752,18 @@ bool KeyStorage::KeyExists(AppID_t appID, KeyID_t keyID) {
 	return gf.FileExist(appID, keyID, File::FileType::Secure);
 }
 
-Util::Error LoadKeyParameters(AppID_t appID, KeyID_t keyID, OpenPGP::AlgoritmAttr& keyParams) {
-
-	keyParams.Clear();
-
-	Factory::SoloFactory &solo = Factory::SoloFactory::GetSoloFactory();
-	File::FileSystem &filesystem = solo.GetFileSystem();
-
-	return keyParams.Load(filesystem, keyID);
-}
-
+// algorithm attributes are resident in the OpenPGP security state
 ECDSAaid KeyStorage::GetECDSACurveID(AppID_t appID, KeyID_t keyID) {
-	OpenPGP::AlgoritmAttr keyParams;
-	auto err = LoadKeyParameters(appID, keyID, keyParams);
-	if (err != Util::Error::NoError)
+	Factory::SoloFactory &solo = Factory::SoloFactory::GetSoloFactory();
+	OpenPGP::AlgoritmAttr *keyParams = solo.GetOpenPGPFactory().GetSecurity().GetAlgoritmAttr(keyID);
+	if (keyParams == nullptr)
 		return ECDSAaid::none;
 
-	if (keyParams.AlgorithmID != AlgoritmID::ECDSAforCDSandIntAuth &&
-		keyParams.AlgorithmID != AlgoritmID::ECDHforDEC)
+	if (keyParams->AlgorithmID != AlgoritmID::ECDSAforCDSandIntAuth &&
+		keyParams->AlgorithmID != AlgoritmID::ECDHforDEC)
 		return ECDSAaid::none;
 
-	return AIDfromOID(keyParams.ECDSAa.OID);
+	return AIDfromOID(keyParams->ECDSAa.OID);
 }
 
 Util::Error KeyStorage::GetECDSAKey(AppID_t appID, KeyID_t keyID, ECDSAKey& key) {
@@ -1001,7 +1007,7 @@ Util::Error KeyStorage::GetPublicKey(AppID_t appID, KeyID_t keyID, uint8_t Algor
 		pubKey = ecdsa_key.Public;
 	}
 
-	printf("GetPublicKey key %x [%lu] loaded.\n", keyID, prvStr.length());
+	TRACE_DEBUG(Trace::KeyLoaded, keyID, nullptr, prvStr.length());
 
 	return Util::Error::NoError;
 }
@@ -1015,8 +1021,7 @@ Util::Error KeyStorage::GetPublicKey7F49(AppID_t appID, KeyID_t keyID,
 	if (err != Util::Error::NoError)
 		return err;
 
-	printf("pubKey: %lu\n", pubKey.length());
-	dump_hex(pubKey);
+	TRACE_DEBUG(Trace::PublicKey, keyID, pubKey);
 
 	using namespace Util;
 
@@ -1033,7 +1038,6 @@ Util::Error KeyStorage::GetPublicKey7F49(AppID_t appID, KeyID_t keyID,
 
 		tlv.AddChild(0x81, &pubKey);
 		tlv.AddNext(0x82, &strExp);
-		tlv.PrintTree();
 
 	} else {
 		tlv.AddChild(0x86, &pubKey);
@@ -1056,7 +1060,7 @@ Util::Error KeyStorage::GetRSAKey(AppID_t appID, KeyID_t keyID, RSAKey& key) {
 	if (err != Util::Error::NoError)
 		return err;
 
-	printf("key %x [%lu] loaded.\n", keyID, prvStr.length());
+	TRACE_DEBUG(Trace::KeyLoaded, keyID, nullptr, prvStr.length());
 
 	GetKeyPart(prvStr, KeyPartsRSA::PublicExponent, key.Exp);
 	GetKeyPart(prvStr, KeyPartsRSA::P, key.P);
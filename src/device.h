@@ -4,14 +4,10 @@
 #include <cstdint>
 #include <cstdlib>
 
-void ccid_init();
-
-uint32_t ccid_recv(uint8_t * buf);
-
-void ccid_send(uint8_t * buf, uint32_t sz);
-
 int hwinit();
 int hwreboot();
+// flash image of the pc build. apdu capture saves it, replay restores it.
+uint8_t *hwflash(size_t *size);
 
 bool fileexist(char* name);
 int readfile(char* name, uint8_t * buf, size_t max_size, size_t *size);
@@ -11,6 +11,7 @@
 #include <array>
 #include "device.h"
 #include "tlv.h"
+#include "stats.h"
 #include "applets/openpgp/openpgpconst.h"
 
 namespace File {
@@ -185,6 +186,10 @@ Util::Error ConfigFileSystem::ReadFile(AppID_t AppId, KeyID_t FileID,
 		FillExtendedCapatibilities(data);
 		return Util::Error::NoError;
 
+	// vendor: latency histograms, see stats.h
+	case OpenPGP::PGPConst::StatisticsDO:
+		return Stats::Serialize(data);
+
 	// Algorithm Attributes
 	case 0xc1:  // Sig
 	case 0xc2:  // Dec
@@ -252,16 +257,44 @@ Util::Error GenericFileSystem::SetFileName(AppID_t AppId, KeyID_t FileID,
 		FileType FileType, char* name) {
 	name[0] = '\0';
 
-	sprintf(name, "%d_%d_%d", AppId, FileID, FileType);
+	if (instance == 0)
+		sprintf(name, "%d_%d_%d", AppId, FileID, FileType);
+	else
+		sprintf(name, "c%d_%d_%d_%d", instance, AppId, FileID, FileType);
 
 	return Util::Error::NoError;
 }
 
+DeviceStorage &DeviceStorage::GetDeviceStorage() {
+	static DeviceStorage deviceStorage;
+	return deviceStorage;
+}
+
+bool DeviceStorage::FileExist(char *name) {
+	return fileexist(name);
+}
+
+int DeviceStorage::ReadFile(char *name, uint8_t *buf, size_t max_size, size_t *size) {
+	return readfile(name, buf, max_size, size);
+}
+
+int DeviceStorage::WriteFile(char *name, uint8_t *buf, size_t size) {
+	return writefile(name, buf, size);
+}
+
+int DeviceStorage::DeleteFile(char *name) {
+	return deletefile(name);
+}
+
+int DeviceStorage::DeleteFiles(char *name) {
+	return deletefiles(name);
+}
+
 bool GenericFileSystem::FileExist(AppID_t AppId, KeyID_t FileID, FileType FileType) {
 	char file_name[100] = {0};
 	SetFileName(AppId, FileID, FileType, file_name);
 
-	return fileexist(file_name);
+	return storage->FileExist(file_name);
 }
 
 Util::Error GenericFileSystem::ReadFile(AppID_t AppId, KeyID_t FileID,
@@ -272,12 +305,16 @@ Util::Error GenericFileSystem::ReadFile(AppID_t AppId, KeyID_t FileID,
 	SetFileName(AppId, FileID, FileType, file_name);
 
 	size_t len = 0;
-	int res = readfile(file_name, data.uint8Data(), data.max_length(), &len);
+	int res = storage->ReadFile(file_name, data.uint8Data(), data.max_length(), &len);
 	if (res == 0) {
 		data.set_length(len);
 		return Util::Error::NoError;
 	}
 
+	// the file is there, but not in the buffer
+	if (storage->FileExist(file_name))
+		return Util::Error::OutOfMemory;
+
 	return Util::Error::FileNotFound;
 }
 
@@ -287,7 +324,7 @@ Util::Error GenericFileSystem::WriteFile(AppID_t AppId, KeyID_t FileID,
 	char file_name[100] = {0};
 	SetFileName(AppId, FileID, FileType, file_name);
 
-	int res = writefile(file_name, data.uint8Data(), data.length());
+	int res = storage->WriteFile(file_name, data.uint8Data(), data.length());
 	if (res != 0)
 		return Util::Error::FileWriteError;
 
@@ -306,6 +343,16 @@ bool FileSystem::isTagComposite(Util::tag_t tag) {
 Util::Error FileSystem::ReadFile(AppID_t AppId, KeyID_t FileID,
 		FileType FileType, bstr& data) {
 
+	Stats::Timer timer(Stats::FileRead, 0);
+	auto err = ReadAnyFile(AppId, FileID, FileType, data);
+	timer.SetBytes(data.length());
+	return err;
+}
+
+// composite files read their parts here, so they are counted once
+Util::Error FileSystem::ReadAnyFile(AppID_t AppId, KeyID_t FileID,
+		FileType FileType, bstr& data) {
+
 	data.clear();
 
 	// check if it needs to compose file
@@ -317,7 +364,7 @@ Util::Error FileSystem::ReadFile(AppID_t AppId, KeyID_t FileID,
 	    	if (ctag.TagGroup == FileID) {
 	    		vdata.clear();
 
-	    		auto rerr = ReadFile(AppId, ctag.TagElm, FileType, vdata);
+	    		auto rerr = ReadAnyFile(AppId, ctag.TagElm, FileType, vdata);
 	    		if (rerr != Util::Error::NoError){
 	    			data.clear();
 	    			return rerr;
@@ -356,7 +403,7 @@ Util::Error FileSystem::ReadFile(AppID_t AppId, KeyID_t FileID,
 
 	// from general file system
 	err = genFiles.ReadFile(AppId, FileID, FileType, data);
-	if (err == Util::Error::NoError)
+	if (err != Util::Error::FileNotFound)
 		return err;
 
 	// check if we can read file from config area. here always a lowest priority
@@ -370,6 +417,9 @@ Util::Error FileSystem::ReadFile(AppID_t AppId, KeyID_t FileID,
 OPTIMIZATION_O2 Util::Error FileSystem::WriteFile(AppID_t AppId, KeyID_t FileID,
 		FileType FileType, bstr& data, bool adminMode) {
 
+	Stats::Timer timer(Stats::FileWrite, 0);
+	timer.SetBytes(data.length());
+
 	// to settings file system
 	auto err = settingsFiles.WriteFile(AppId, FileID, FileType, data, adminMode);
 	if (err != Util::Error::FileNotFound)
@@ -389,7 +439,7 @@ Util::Error FileSystem::DeleteFile(AppID_t AppId, KeyID_t FileID,
 	char file_name[100] = {0};
 	genFiles.SetFileName(AppId, FileID, FileType, file_name);
 
-	deletefile(file_name);
+	genFiles.GetStorage().DeleteFile(file_name);
 
 	return Util::Error::NoError;
 }
@@ -397,8 +447,11 @@ Util::Error FileSystem::DeleteFile(AppID_t AppId, KeyID_t FileID,
 Util::Error FileSystem::DeleteFiles(AppID_t AppId) {
 
 	char file_name[100] = {0};
-	sprintf(file_name, "%d_*", AppId);
-	deletefiles(file_name);
+	if (genFiles.GetInstance() == 0)
+		sprintf(file_name, "%d_*", AppId);
+	else
+		sprintf(file_name, "c%d_%d_*", genFiles.GetInstance(), AppId);
+	genFiles.GetStorage().DeleteFiles(file_name);
 
 	return Util::Error::NoError;
 }
@@ -67,9 +67,51 @@ public:
 	Util::Error ReadFile(AppID_t AppId, KeyID_t FileID, FileType FileType, bstr &data);
 };
 
+// storage of the generic files. names are short ascii strings, 0 - ok
+class Storage {
+public:
+	virtual ~Storage() {};
+
+	virtual bool FileExist(char *name) = 0;
+	virtual int ReadFile(char *name, uint8_t *buf, size_t max_size, size_t *size) = 0;
+	virtual int WriteFile(char *name, uint8_t *buf, size_t size) = 0;
+	virtual int DeleteFile(char *name) = 0;
+	// name - fnmatch pattern
+	virtual int DeleteFiles(char *name) = 0;
+};
+
+// flash of the device or the data dir of the pc build. see device.h
+class DeviceStorage : public Storage {
+public:
+	bool FileExist(char *name) override;
+	int ReadFile(char *name, uint8_t *buf, size_t max_size, size_t *size) override;
+	int WriteFile(char *name, uint8_t *buf, size_t size) override;
+	int DeleteFile(char *name) override;
+	int DeleteFiles(char *name) override;
+
+	static DeviceStorage &GetDeviceStorage();
+};
+
 class GenericFileSystem {
 private:
+	uint8_t instance = 0;
+	Storage *storage = &DeviceStorage::GetDeviceStorage();
 public:
+	// nullptr - device storage
+	void SetStorage(Storage *_storage) {
+		storage = _storage ? _storage : &DeviceStorage::GetDeviceStorage();
+	}
+	Storage &GetStorage() {
+		return *storage;
+	}
+
+	void SetInstance(uint8_t _instance) {
+		instance = _instance;
+	}
+	uint8_t GetInstance() {
+		return instance;
+	}
+
 	Util::Error SetFileName(AppID_t AppId, KeyID_t FileID, FileType FileType, char *name);
 
 	bool FileExist(AppID_t AppId, KeyID_t FileID, FileType FileType);
@@ -84,6 +126,7 @@ private:
 	SettingsFileSystem settingsFiles{*this};
 
 	bool isTagComposite(Util::tag_t tag);
+	Util::Error ReadAnyFile(AppID_t AppId, KeyID_t FileID, FileType FileType, bstr &data);
 
 public:
 	Util::Error ReadFile(AppID_t AppId, KeyID_t FileID, FileType FileType, bstr &data);
@@ -92,6 +135,16 @@ public:
 	Util::Error DeleteFile(AppID_t AppId, KeyID_t FileID, FileType FileType);
 	Util::Error DeleteFiles(AppID_t AppId);
 
+	// several cards in one storage. files of instance > 0 have "c<instance>_" prefix
+	void SetInstance(uint8_t instance) {
+		genFiles.SetInstance(instance);
+	}
+
+	// files of the card somewhere else than the device storage. set it before Init of the card
+	void SetStorage(Storage *storage) {
+		genFiles.SetStorage(storage);
+	}
+
 	ConfigFileSystem &getCfgFiles() {
 		return cfgFiles;
 	}
@@ -2,104 +2,160 @@
 #include <cstdlib>
 #include <chrono>
 #include <thread>
+#include <mutex>
 
 #include "device.h"
 #include "solofactory.h"
 #include "util.h"
 #include "applets/apduconst.h"
 #include "ccid.h"
-
-#define USBIP_MODE
-
-Applet::APDUExecutor *fexecutor;
-void exchangeFunc(uint8_t *datain, size_t datainlen, uint8_t *dataout, size_t *outlen) {
+#include "apdusock.h"
+#include "shmring.h"
+#include "config.h"
+#include "tracedrain.h"
+#include "apducapture.h"
+#include "sigthread.h"
+#include "stats.h"
+#include "trace.h"
+
+#define APDUSOCK_MODE
+#define SHMAPDU_MODE
+
+// one factory per card: own file names and security state. card 0 is the default factory.
+Factory::SoloFactory *cards[CCID_CARD_COUNT];
+// ccid workers, apdusock and shmapdu threads share the cards. different cards run in parallel
+std::mutex cardMutex[CCID_CARD_COUNT];
+void cardExchange(uint8_t card, uint8_t *datain, size_t datainlen, uint8_t *dataout, size_t *outlen, bool log) {
 	*outlen = 0;
 
-	uint8_t apdu_result[4096] = {0};
-	auto resstr = bstr(apdu_result, 0, sizeof(apdu_result) - 10);
+	if (card >= CCID_CARD_COUNT)
+		return;
+	std::lock_guard<std::mutex> lock(cardMutex[card]);
+	if (cards[card] == nullptr) {
+		cards[card] = new Factory::SoloFactory();
+		cards[card]->Init(card);
+		printf("card %d created\n", card);
+	}
+	Factory::SoloFactoryScope scope(*cards[card]);
+
+	// extended apdu response, built in place in the transport buffer.
+	// ccid abData limits its length, all the buffers have CCID_RESPONSE_BUFFER_SIZE
+	auto resstr = bstr(dataout, 0, CCID_MAX_APDU_LENGTH);
 	auto apdu = bstr(datain, datainlen);
 
-	printf("================\n");
-	printf("a>> "); dump_hex(apdu);
-    fexecutor->Execute(apdu, resstr);
-    printf("a<< "); dump_hex(resstr);
+	if (log)
+		TRACE_INFO(Trace::APDUIn, card, apdu);
+	uint64_t start = apducapture_enabled() ? apducapture_now_us() : 0;
+    cards[card]->GetAPDUExecutor().Execute(apdu, resstr, CCID_RESPONSE_BUFFER_SIZE);
+    if (apducapture_enabled())
+    	apducapture_write(card, datain, datainlen, resstr.data(), resstr.length(), start, apducapture_now_us());
+    if (log)
+    	TRACE_INFO(Trace::APDUOut, card, resstr);
 
     *outlen = resstr.length();
-    memcpy(dataout, apdu_result, *outlen);
+}
+
+void exchangeFunc(uint8_t card, uint8_t *datain, size_t datainlen, uint8_t *dataout, size_t *outlen) {
+	cardExchange(card, datain, datainlen, dataout, outlen, true);
+}
+
+// benchmark transport: even the trace of each apdu costs more than the applet
+void benchExchangeFunc(uint8_t card, uint8_t *datain, size_t datainlen, uint8_t *dataout, size_t *outlen) {
+	cardExchange(card, datain, datainlen, dataout, outlen, false);
+}
+
+// statistics of each card that is in use
+static void printStats() {
+	for (int i = 0; i < CCID_CARD_COUNT; i++) {
+		std::lock_guard<std::mutex> lock(cardMutex[i]);
+		if (cards[i] == nullptr)
+			continue;
+		printf("card %d\n", i);
+		cards[i]->GetStats().Print();
+	}
 }
 
 int main(int argc, char * argv[])
 {
-	uint8_t ccidbuf[350];
-    uint32_t sz;
+    // ports, storage and bus ids. see pc/config.h
+    if (config_load(argc, argv))
+        return 1;
+
+    // before any thread: the dump signals must be blocked in all of them
+    if (sigthread_start(SIGUSR1, [](int) {printStats();}))
+        return 1;
+
+    Trace::level = solo_config.tracelevel;
+    if (solo_config.tracefile[0]) {
+        if (tracedrain_start(solo_config.tracefile))
+            return 1;
+    } else {
+        char dumppath[CONFIG_PATH_SIZE * 2];
+        config_data_path(dumppath, sizeof(dumppath), TRACEDRAIN_DUMP_FILE);
+        if (tracedrain_dump_on_signal(TRACEDRAIN_DUMP_SIGNAL, dumppath))
+            return 1;
+    }
+
     printf("------------------\n");
     printf("OpenPGP Starting...\n");
 
-    hwinit();
+    if (hwinit())
+        return 1;
     printf("Init hardware ok\n");
 
-    ccid_init();
-    printf("Init CCID ok\n");
-
     Factory::SoloFactory &factory = Factory::SoloFactory::GetSoloFactory();
     factory.Init();  // init solokey
-    Applet::APDUExecutor executor = factory.GetAPDUExecutor();
-    fexecutor = &executor;
+    cards[0] = &factory;
 
     printf("OpenPGP factory ok.\n");
 
-#ifdef USBIP_MODE
-    printf("USBIP mode.\n");
-    std::thread t([] {
-    		std::this_thread::sleep_for(std::chrono::seconds(2));
-    		// needs too add NOPASSWD line to /etc/sudoers file!!!
-    		int res = system("sudo usbip attach -r 127.0.0.1 -b 1-1");
-    		if (!res)
-    			printf("attach ok\n");
-    });
-    //t.detach();
-
-    usbip_ccid_start(&exchangeFunc);
-    return 0;
+    // replay starts from the same flash image
+    if (solo_config.capturefile[0]) {
+    	size_t imagesize = 0;
+    	uint8_t *image = hwflash(&imagesize);
+    	if (apducapture_open(solo_config.capturefile, image, imagesize))
+    		return 1;
+    }
+
+#ifdef APDUSOCK_MODE
+    // local pcscd reaches the card via pc/ifd driver without usbip
+    if (solo_config.apdusock[0]) {
+    	std::thread ts([] {
+    			apdusock_start(solo_config.apdusock, &exchangeFunc);
+    	});
+    	ts.detach();
+    }
 #endif
 
-	uint8_t result[300] = {0};
-    while (1)
-    {
-    	auto resstr = bstr(&result[10], 0, sizeof(result) - 10);
-        if ((sz = ccid_recv(ccidbuf)) > 0)
-        {
-        	// pack("<BiBBBH", msg_type, len(data), slot, seq, rsv, param) + data
-        	if (ccidbuf[0] != 0x6f)
-        		printf("warning: msg_type not 6f. 0x%02x\n", ccidbuf[0]);
-        	size_t len = ccidbuf[1] + (ccidbuf[2] << 8) + (ccidbuf[3] << 16) + (ccidbuf[4] << 24);
-        	if (len + 10U != sz)
-        		printf("warning: length error. data len %d pck len %d", sz, ccidbuf[1]);
-
-        	auto apdu = bstr(&ccidbuf[10], sz - 10);
-            printf(">> "); dump_hex(apdu);
-
-            executor.Execute(apdu, resstr);
-
-            printf("<< "); dump_hex(resstr);
-
-            // msg_type = msg[0]; data_len = msg[1] + (msg[2] << 8) + (msg[3] << 16) + (msg[4] << 24)
-            // slot = msg[5]; seq = msg[6]; status = msg[7]; error = msg[8]; chain = msg[9]; data = msg[10:]
-            result[0] = ccidbuf[0];
-            size_t rlen = resstr.length();
-            result[1] = rlen & 0xff;
-            result[2] = (rlen >> 8) & 0xff;
-            result[3] = (rlen >> 16) & 0xff;
-            result[4] = (rlen >> 24) & 0xff;
-            // slot
-            result[5] = ccidbuf[5];
-            // seq
-            result[6] = ccidbuf[6];
-
-            ccid_send(result, rlen + 10);
-
-        }
+#ifdef SHMAPDU_MODE
+    // shared memory rings for tools/shmbench
+    if (solo_config.shmname[0]) {
+    	std::thread tm([] {
+    			shmapdu_start(solo_config.shmname, &benchExchangeFunc);
+    	});
+    	tm.detach();
     }
+#endif
+
+    if (solo_config.mode == CONFIG_MODE_USBIP) {
+    	printf("USBIP mode.\n");
+    	if (solo_config.attachcmd[0]) {
+    		std::thread t([] {
+    				std::this_thread::sleep_for(std::chrono::seconds(2));
+    				// needs too add NOPASSWD line to /etc/sudoers file!!!
+    				int res = system(solo_config.attachcmd);
+    				if (!res)
+    					printf("attach ok\n");
+    		});
+    		t.detach();
+    	}
+
+    	usbip_ccid_start(solo_config.usbipport, solo_config.usbipbus, &exchangeFunc);
+    	return 0;
+    }
+
+    printf("UDP mode.\n");
+    udp_ccid_start(solo_config.udpport, &exchangeFunc);
 
     return 0;
 }
@@ -11,13 +11,29 @@
 
 namespace Factory {
 
-static SoloFactory soloFactory;
+// per thread: cards of the library run in parallel threads. see lib/solopgp.h
+// nullptr - GetDefaultFactory(), solofactorydefault.cpp or the library's one
+static thread_local SoloFactory *currentFactory = nullptr;
 
 SoloFactory &SoloFactory::GetSoloFactory() {
-	return soloFactory;
+	if (currentFactory == nullptr)
+		return GetDefaultFactory();
+	return *currentFactory;
 }
 
-Util::Error SoloFactory::Init() {
+SoloFactory *SoloFactory::GetCurrent() {
+	return currentFactory;
+}
+
+void SoloFactory::SetCurrent(SoloFactory *factory) {
+	currentFactory = factory;
+}
+
+Util::Error SoloFactory::Init(uint8_t instance) {
+	SoloFactoryScope scope(*this);
+
+	fileSystem.SetInstance(instance);
+	openPGPFactory.GetSecurity().Init();
 
 	return Util::NoError;
 }
@@ -50,5 +66,9 @@ FileSystem& Factory::SoloFactory::GetFileSystem() {
 	return fileSystem;
 }
 
+Stats::Table& SoloFactory::GetStats() {
+	return stats;
+}
+
 }
 
@@ -16,6 +16,7 @@
 #include "applets/appletstorage.h"
 #include "applets/openpgp/openpgpfactory.h"
 #include "filesystem.h"
+#include "stats.h"
 
 namespace Factory {
 
@@ -34,8 +35,11 @@ namespace Factory {
 		CryptoEngine cryptoEngine;
 
 		FileSystem fileSystem;
+
+		Stats::Table stats;
 	public:
-		Util::Error Init();
+		// instance - card number. 0 keeps the file names of a single card.
+		Util::Error Init(uint8_t instance = 0);
 
 		APDUExecutor &GetAPDUExecutor();
 
@@ -47,8 +51,27 @@ namespace Factory {
 
 		OpenPGPFactory &GetOpenPGPFactory();
 		FileSystem &GetFileSystem();
+		Stats::Table &GetStats();
 
 		static SoloFactory &GetSoloFactory();
+		// the factory outside of any scope. the firmware and the pc programs link
+		// solofactorydefault.cpp, libsolopgp has no default card and aborts
+		static SoloFactory &GetDefaultFactory();
+		static SoloFactory *GetCurrent();
+		static void SetCurrent(SoloFactory *factory);
+	};
+
+	// GetSoloFactory returns factory while the scope is alive
+	class SoloFactoryScope {
+	private:
+		SoloFactory *prev;
+	public:
+		SoloFactoryScope(SoloFactory &factory) : prev(SoloFactory::GetCurrent()) {
+			SoloFactory::SetCurrent(&factory);
+		}
+		~SoloFactoryScope() {
+			SoloFactory::SetCurrent(prev);
+		}
 	};
 
 }
@@ -0,0 +1,171 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+#include "stats.h"
+#include <chrono>
+#include "solofactory.h"
+
+namespace Stats {
+
+static const auto startTime = std::chrono::steady_clock::now();
+
+Histogram &Get(Kind kind, uint8_t id) {
+	return Factory::SoloFactory::GetSoloFactory().GetStats().Get(kind, id);
+}
+
+Util::Error Serialize(bstr &data) {
+	return Factory::SoloFactory::GetSoloFactory().GetStats().Serialize(data);
+}
+
+Histogram &Table::Get(Kind kind, uint8_t id) {
+	if (kind == INS && insSlot[id].load(std::memory_order_acquire) == 0) {
+		if (insSlotUsed >= InsSlotCount)
+			return dummyHist;
+		insSlotUsed++;
+		insSlot[id].store(insSlotUsed, std::memory_order_release);
+	}
+
+	Histogram *hist = Find(kind, id);
+	return hist ? *hist : dummyHist;
+}
+
+Histogram *Table::Find(Kind kind, uint8_t id) {
+	switch (kind) {
+	case INS: {
+		uint8_t slot = insSlot[id].load(std::memory_order_acquire);
+		if (slot)
+			return &insHist[slot - 1];
+		break;
+	}
+	case Crypto:
+		if (id < CryptoOpCount)
+			return &cryptoHist[id];
+		break;
+	case FileRead:
+		return &fileHist[0];
+	case FileWrite:
+		return &fileHist[1];
+	}
+	return nullptr;
+}
+
+uint64_t Now() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - startTime).count();
+}
+
+static void AppendBE(bstr &data, uint64_t value, size_t len) {
+	for (size_t i = 0; i < len; i++)
+		data.append(static_cast<uint8_t>(value >> (8 * (len - 1 - i))));
+}
+
+Util::Error Table::SerializeHist(bstr &data, Kind kind, uint8_t id) {
+	Histogram *phist = Find(kind, id);
+	if (phist == nullptr)
+		return Util::Error::NoError;
+	Histogram &hist = *phist;
+	uint32_t count = hist.count.load(std::memory_order_relaxed);
+	if (count == 0)
+		return Util::Error::NoError;
+
+	uint32_t mask = 0;
+	uint32_t buckets[BucketCount];
+	for (size_t i = 0; i < BucketCount; i++) {
+		buckets[i] = hist.buckets[i].load(std::memory_order_relaxed);
+		if (buckets[i])
+			mask |= 1U << i;
+	}
+
+	if (data.free_space() < 2 + 4 + 8 + 4 + 8 + 4 + 4 * BucketCount)
+		return Util::Error::OutOfMemory;
+
+	data.append(kind);
+	data.append(id);
+	AppendBE(data, count, 4);
+	AppendBE(data, hist.total.load(std::memory_order_relaxed), 8);
+	AppendBE(data, hist.max.load(std::memory_order_relaxed), 4);
+	AppendBE(data, hist.bytes.load(std::memory_order_relaxed), 8);
+	AppendBE(data, mask, 4);
+	for (size_t i = 0; i < BucketCount; i++)
+		if (buckets[i])
+			AppendBE(data, buckets[i], 4);
+
+	return Util::Error::NoError;
+}
+
+Util::Error Table::Serialize(bstr &data) {
+	data.clear();
+	if (!STATS_ENABLED)
+		return Util::Error::NoError;
+	if (data.free_space() < 2)
+		return Util::Error::OutOfMemory;
+
+	data.append(FormatVersion);
+	data.append(BucketCount);
+
+	for (int i = 0; i < 256; i++) {
+		auto err = SerializeHist(data, INS, i);
+		if (err != Util::Error::NoError)
+			return err;
+	}
+	for (int i = 0; i < CryptoOpCount; i++) {
+		auto err = SerializeHist(data, Crypto, i);
+		if (err != Util::Error::NoError)
+			return err;
+	}
+	auto err = SerializeHist(data, FileRead, 0);
+	if (err != Util::Error::NoError)
+		return err;
+	return SerializeHist(data, FileWrite, 0);
+}
+
+void Table::PrintHist(const char *name, Kind kind, uint8_t id) {
+	Histogram *phist = Find(kind, id);
+	if (phist == nullptr)
+		return;
+	Histogram &hist = *phist;
+	uint32_t count = hist.count.load(std::memory_order_relaxed);
+	if (count == 0)
+		return;
+
+	printf("%-20s count %u avg %lu us max %u us",
+			name, count,
+			static_cast<unsigned long>(hist.total.load(std::memory_order_relaxed) / count),
+			hist.max.load(std::memory_order_relaxed));
+	if (kind == FileRead || kind == FileWrite)
+		printf(" bytes %lu", static_cast<unsigned long>(hist.bytes.load(std::memory_order_relaxed)));
+	printf("\n   ");
+
+	// upper bound of the bucket: count
+	for (size_t i = 0; i < BucketCount; i++) {
+		uint32_t n = hist.buckets[i].load(std::memory_order_relaxed);
+		if (n == 0)
+			continue;
+		if (i == BucketCount - 1)
+			printf(" >=%luus:%u", 1UL << (i - 1), n);
+		else
+			printf(" <%luus:%u", 1UL << i, n);
+	}
+	printf("\n");
+}
+
+void Table::Print() {
+	printf("------------ statistics ------------\n");
+	char name[20];
+	for (int i = 0; i < 256; i++) {
+		snprintf(name, sizeof(name), "ins %02x", i);
+		PrintHist(name, INS, i);
+	}
+	for (int i = 0; i < CryptoOpCount; i++)
+		PrintHist(CryptoOpNames[i], Crypto, i);
+	PrintHist("file read", FileRead, 0);
+	PrintHist("file write", FileWrite, 0);
+}
+
+} /* namespace Stats */
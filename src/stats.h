@@ -0,0 +1,156 @@
+/*
+ Copyright 2019 SoloKeys Developers
+
+ Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ http://opensource.org/licenses/MIT>, at your option. This file may not be
+ copied, modified, or distributed except according to those terms.
+ */
+
+#ifndef SRC_STATS_H_
+#define SRC_STATS_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include "util.h"
+#include "errors.h"
+
+// 0 - timers are empty and the statistics DO is empty
+#ifndef STATS_ENABLED
+#define STATS_ENABLED 1
+#endif
+
+namespace Stats {
+
+// bucket 0: 0 us, bucket i: [2^(i-1), 2^i) us. the last one has all the longer operations.
+constexpr size_t BucketCount = 24;
+constexpr uint8_t FormatVersion = 1;
+// histograms for the first InsSlotCount different INS of a card, the rest are not counted.
+// OpenPGP, ISO and test applet commands together use about 25
+constexpr size_t InsSlotCount = 32;
+
+enum Kind : uint8_t {
+	INS       = 1,   // id - instruction byte, time of APDUExecutor::Execute
+	Crypto    = 2,   // id - CryptoOp
+	FileRead  = 3,   // id - 0, bytes read
+	FileWrite = 4,   // id - 0, bytes written
+};
+
+enum CryptoOp : uint8_t {
+	GenerateRandom,
+	AESEncrypt,
+	AESDecrypt,
+	RSAGenKey,
+	RSACalcPublicKey,
+	RSASign,
+	RSADecipher,
+	RSAVerify,
+	ECDSAGenKey,
+	ECDSACalcPublicKey,
+	ECDSASign,
+	ECDSAVerify,
+	ECDHComputeShared,
+	CryptoOpCount,
+};
+
+constexpr const char *CryptoOpNames[CryptoOpCount] = {
+	"GenerateRandom",
+	"AESEncrypt",
+	"AESDecrypt",
+	"RSAGenKey",
+	"RSACalcPublicKey",
+	"RSASign",
+	"RSADecipher",
+	"RSAVerify",
+	"ECDSAGenKey",
+	"ECDSACalcPublicKey",
+	"ECDSASign",
+	"ECDSAVerify",
+	"ECDHComputeShared",
+};
+
+constexpr size_t Bucket(uint32_t us) {
+	size_t bucket = 0;
+	while (us && bucket < BucketCount - 1) {
+		us >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+// writers are serialized by the executor, atomics are for the readers in other threads
+struct Histogram {
+	std::atomic<uint32_t> count;
+	std::atomic<uint32_t> max;       // us
+	std::atomic<uint64_t> total;     // us
+	std::atomic<uint64_t> bytes;
+	std::atomic<uint32_t> buckets[BucketCount];
+
+	void Add(uint32_t us, size_t len) {
+		count.fetch_add(1, std::memory_order_relaxed);
+		total.fetch_add(us, std::memory_order_relaxed);
+		bytes.fetch_add(len, std::memory_order_relaxed);
+		if (us > max.load(std::memory_order_relaxed))
+			max.store(us, std::memory_order_relaxed);
+		buckets[Bucket(us)].fetch_add(1, std::memory_order_relaxed);
+	}
+};
+
+// histograms of one card, a member of Factory::SoloFactory
+class Table {
+private:
+	// INS -> slot + 1 in insHist, 0 - no histogram yet
+	std::atomic<uint8_t> insSlot[256] = {};
+	size_t insSlotUsed = 0;
+	Histogram insHist[InsSlotCount] = {};
+	Histogram cryptoHist[CryptoOpCount] = {};
+	Histogram fileHist[2] = {};
+	Histogram dummyHist = {};
+
+	Util::Error SerializeHist(bstr &data, Kind kind, uint8_t id);
+	void PrintHist(const char *name, Kind kind, uint8_t id);
+public:
+	// writer: takes a free INS slot for a new INS
+	Histogram &Get(Kind kind, uint8_t id);
+	// reader: nullptr if there is no histogram
+	Histogram *Find(Kind kind, uint8_t id);
+
+	// statistics DO, big endian:
+	// version(1) bucket count(1), then for each used histogram:
+	// kind(1) id(1) count(4) total us(8) max us(4) bytes(8) bucket mask(4) counts of the buckets in the mask(4 each)
+	Util::Error Serialize(bstr &data);
+	// text to stdout
+	void Print();
+};
+
+// histogram and statistics DO of the current card, see Factory::SoloFactoryScope
+Histogram &Get(Kind kind, uint8_t id);
+Util::Error Serialize(bstr &data);
+uint64_t Now();
+
+// adds the time from the constructor to the destructor
+class Timer {
+#if STATS_ENABLED
+private:
+	Histogram &hist;
+	uint64_t start;
+	size_t bytes = 0;
+public:
+	Timer(Kind kind, uint8_t id) : hist(Get(kind, id)), start(Now()) {};
+	~Timer() {
+		hist.Add(Now() - start, bytes);
+	}
+	void SetBytes(size_t len) {
+		bytes = len;
+	}
+#else
+public:
+	Timer(Kind kind, uint8_t id) {};
+	void SetBytes(size_t len) {};
+#endif
+};
+
+} /* namespace Stats */
+
+#endif /* SRC_STATS_H_ */
@@ -0,0 +1,41 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+#include "trace.h"
+#include <chrono>
+
+namespace Trace {
+
+std::atomic<uint8_t> level{Info};
+
+static TraceRing<TRACE_RING_SIZE> ring;
+static const auto startTime = std::chrono::steady_clock::now();
+
+void Write(Level lvl, Event event, uint32_t value, const uint8_t *data, size_t len) {
+	Record rec;
+	rec.time = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - startTime).count();
+	rec.event = event;
+	rec.level = lvl;
+	rec.value = value;
+	rec.length = len;
+	rec.datalen = data ? MIN(len, RecordDataLength) : 0;
+	memset(rec.data, 0, sizeof(rec.data));
+	if (rec.datalen)
+		memcpy(rec.data, data, rec.datalen);
+
+	ring.Write(rec);
+}
+
+// one consumer at a time: the drain thread or a dump
+bool Read(Record &rec, uint32_t &lost) {
+	return ring.Read(rec, lost);
+}
+
+} /* namespace Trace */
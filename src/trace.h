@@ -0,0 +1,287 @@
+/*
+ Copyright 2019 SoloKeys Developers
+
+ Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ http://opensource.org/licenses/MIT>, at your option. This file may not be
+ copied, modified, or distributed except according to those terms.
+ */
+
+#ifndef SRC_TRACE_H_
+#define SRC_TRACE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include "util.h"
+#include "errors.h"
+
+// compile time level. sites above it are removed by the compiler.
+#define TRACE_LEVEL_NONE	0
+#define TRACE_LEVEL_ERROR	1
+#define TRACE_LEVEL_INFO	2
+#define TRACE_LEVEL_DEBUG	3
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_LEVEL_DEBUG
+#endif
+
+// records in the ring, power of 2
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE 1024
+#endif
+
+namespace Trace {
+
+enum Level {
+	None  = TRACE_LEVEL_NONE,
+	Error = TRACE_LEVEL_ERROR,
+	Info  = TRACE_LEVEL_INFO,
+	Debug = TRACE_LEVEL_DEBUG,
+};
+
+// value and data meaning depends on the event. see Format.
+enum Event : uint16_t {
+	APDUIn,          // value: card, data: apdu
+	APDUOut,         // value: card, data: response
+	APDUDecoded,     // data: APDUDecodedData
+	APDUResult,      // value: Util::Error
+	NotSelected,     // value: channel
+	Command,         // value: ins, data: name
+	AccessDenied,    // value: ins
+	KeyLoaded,       // value: key id, length: key length
+	PublicKey,       // value: key id, data: public key
+	DataRead,        // value: data object id
+	DataWrite,       // value: data object id, length: data length
+	KeyImport,       // length: extended header list length
+	KeyPair,         // value: key file id, data: p1, algorithm id
+	EventCount,
+};
+
+constexpr const char *EventNames[EventCount] = {
+	"apdu in",
+	"apdu out",
+	"apdu",
+	"apdu result",
+	"not selected",
+	"command",
+	"access denied",
+	"key loaded",
+	"public key",
+	"get data",
+	"put data",
+	"key import",
+	"key pair",
+};
+
+constexpr size_t RecordDataLength = 16;
+
+// fixed size record. binary trace file is a sequence of them.
+struct Record {
+	uint64_t time;                   // us from the start of the program
+	uint16_t event;
+	uint8_t level;
+	uint8_t datalen;                 // bytes in data, data is cut to RecordDataLength
+	uint32_t value;
+	uint32_t length;                 // full length of the data
+	uint32_t seq;                    // record number, gaps - lost records
+	uint8_t data[RecordDataLength];
+};
+static_assert(sizeof(Record) == 40, "record size is a part of the file format");
+
+// APDUDecoded data
+struct APDUDecodedData {
+	uint8_t case_type;
+	uint8_t channel;
+	uint8_t cla;
+	uint8_t ins;
+	uint8_t p1;
+	uint8_t p2;
+	uint8_t extended_apdu;
+	uint8_t reserved;
+	uint32_t lc;
+	uint32_t le;
+};
+static_assert(sizeof(APDUDecodedData) <= RecordDataLength, "decoded apdu must fit to a record");
+
+// multi producer single consumer. producers never wait: the oldest records are overwritten.
+// slot sequence is 0 while the record is written, index + 1 when it is ready (seqlock).
+// a record may be torn only if producers lap the whole ring during one write.
+template <size_t Count>
+class TraceRing {
+private:
+	static_assert((Count & (Count - 1)) == 0, "ring size must be a power of 2");
+	static constexpr size_t Words = sizeof(Record) / sizeof(uint32_t);
+
+	struct Slot {
+		std::atomic<uint32_t> seq;
+		std::atomic<uint32_t> words[Words];
+	};
+
+	std::atomic<uint32_t> head{0};
+	Slot slots[Count] = {};
+	uint32_t tail = 0;               // consumer only
+public:
+	void Write(Record &rec) {
+		uint32_t idx = head.fetch_add(1, std::memory_order_relaxed);
+		Slot &slot = slots[idx & (Count - 1)];
+		rec.seq = idx;
+
+		uint32_t words[Words];
+		memcpy(words, &rec, sizeof(rec));
+
+		slot.seq.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < Words; i++)
+			slot.words[i].store(words[i], std::memory_order_relaxed);
+		slot.seq.store(idx + 1, std::memory_order_release);
+	}
+
+	// consumer. false if there is no ready record. lost is incremented by overwritten records.
+	bool Read(Record &rec, uint32_t &lost) {
+		while (true) {
+			uint32_t h = head.load(std::memory_order_acquire);
+			if (tail == h)
+				return false;
+			if (h - tail > Count) {
+				lost += h - tail - Count;
+				tail = h - Count;
+			}
+
+			Slot &slot = slots[tail & (Count - 1)];
+			uint32_t seq = slot.seq.load(std::memory_order_acquire);
+			int32_t diff = static_cast<int32_t>(seq - (tail + 1));
+			// being written or not written yet
+			if (seq == 0 || diff < 0)
+				return false;
+			// overwritten by the next lap
+			if (diff > 0) {
+				lost++;
+				tail++;
+				continue;
+			}
+
+			uint32_t words[Words];
+			for (size_t i = 0; i < Words; i++)
+				words[i] = slot.words[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.seq.load(std::memory_order_relaxed) != seq) {
+				lost++;
+				tail++;
+				continue;
+			}
+
+			memcpy(&rec, words, sizeof(rec));
+			tail++;
+			return true;
+		}
+	}
+};
+
+// runtime level, Info by default
+extern std::atomic<uint8_t> level;
+
+void Write(Level lvl, Event event, uint32_t value, const uint8_t *data, size_t len);
+bool Read(Record &rec, uint32_t &lost);
+
+inline void Write(Level lvl, Event event, uint32_t value) {
+	Write(lvl, event, value, nullptr, 0);
+}
+
+inline void Write(Level lvl, Event event, uint32_t value, const bstr &data) {
+	Write(lvl, event, value, data.data(), data.length());
+}
+
+inline void Write(Level lvl, Event event, uint32_t value, std::string_view data) {
+	Write(lvl, event, value, reinterpret_cast<const uint8_t *>(data.data()), data.size());
+}
+
+inline void Write(Level lvl, Event event, uint32_t value, const APDUDecodedData &data) {
+	Write(lvl, event, value, reinterpret_cast<const uint8_t *>(&data), sizeof(data));
+}
+
+// text line of the record without the new line. used by the drain thread and tools/tracedump.
+inline void Format(const Record &rec, char *str, size_t maxlen) {
+	int n = snprintf(str, maxlen, "%llu.%06llu ",
+			static_cast<unsigned long long>(rec.time / 1000000),
+			static_cast<unsigned long long>(rec.time % 1000000));
+	auto add = [&](const char *fmt, auto... args) {
+		if (n >= 0 && static_cast<size_t>(n) < maxlen)
+			n += snprintf(str + n, maxlen - n, fmt, args...);
+	};
+	auto hex = [&]() {
+		for (size_t i = 0; i < rec.datalen && i < RecordDataLength; i++)
+			add("%02x ", rec.data[i]);
+		if (rec.length > rec.datalen)
+			add("%s", "...");
+	};
+
+	if (rec.event < EventCount)
+		add("%s: ", EventNames[rec.event]);
+	else
+		add("event %d: ", rec.event);
+
+	switch (rec.event) {
+	case APDUIn:
+	case APDUOut:
+		add("card %u [%u] ", rec.value, rec.length);
+		hex();
+		break;
+	case APDUDecoded: {
+		APDUDecodedData d;
+		memset(&d, 0, sizeof(d));
+		memcpy(&d, rec.data, MIN(sizeof(d), static_cast<size_t>(rec.datalen)));
+		add("%scase=0x%02x ch=%d cla=0x%02x ins=0x%02x p1=0x%02x p2=0x%02x Lc=0x%02x(%u) Le=0x%02x(%u)",
+				d.extended_apdu ? "[e]" : "", d.case_type, d.channel, d.cla, d.ins, d.p1, d.p2, d.lc, d.lc, d.le, d.le);
+		break;
+	}
+	case APDUResult:
+		add("%s", Util::GetStrError(static_cast<Util::Error>(rec.value)));
+		break;
+	case Command:
+		add("ins=0x%02x %.*s", rec.value, static_cast<int>(rec.datalen), reinterpret_cast<const char *>(rec.data));
+		break;
+	case KeyLoaded:
+		add("key %x [%u]", rec.value, rec.length);
+		break;
+	case PublicKey:
+		add("key %x [%u] ", rec.value, rec.length);
+		hex();
+		break;
+	case DataRead:
+		add("do 0x%04x", rec.value);
+		break;
+	case DataWrite:
+		add("do 0x%04x [%u]", rec.value, rec.length);
+		break;
+	case KeyImport:
+		add("[%u]", rec.length);
+		break;
+	case KeyPair:
+		add("key 0x%02x p1=0x%02x alg=%u", rec.value, rec.datalen > 0 ? rec.data[0] : 0, rec.datalen > 1 ? rec.data[1] : 0);
+		break;
+	default:
+		add("0x%x ", rec.value);
+		hex();
+		break;
+	}
+}
+
+} /* namespace Trace */
+
+// TRACE_INFO(Trace::Command, ins, name). arguments are not evaluated if the level is off.
+#define TRACE(lvl, ...) \
+	do { \
+		if constexpr ((lvl) <= TRACE_LEVEL) { \
+			if ((lvl) <= Trace::level.load(std::memory_order_relaxed)) \
+				Trace::Write((lvl), __VA_ARGS__); \
+		} \
+	} while (0)
+
+#define TRACE_ERROR(...)	TRACE(Trace::Error, __VA_ARGS__)
+#define TRACE_INFO(...)		TRACE(Trace::Info, __VA_ARGS__)
+#define TRACE_DEBUG(...)	TRACE(Trace::Debug, __VA_ARGS__)
+
+#endif /* SRC_TRACE_H_ */
@@ -0,0 +1,208 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+// Replay of a capture (--capture-file of ./main) against APDUExecutor in this process.
+// Restores the flash image of the capture to a temporary data dir, checks the responses
+// byte by byte and prints latency per INS. Built by the root Makefile: make apdureplay
+// apdureplay [-x ins] [-v] capture
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "device.h"
+#include "solofactory.h"
+#include "trace.h"
+#include "ccid.h"
+#include "config.h"
+#include "apducapture.h"
+
+typedef struct _INS_STAT
+{
+    uint64_t count;
+    uint64_t total;         // us, replay
+    uint64_t min;
+    uint64_t max;
+    uint64_t captured;      // us, capture
+    uint64_t mismatch;
+}INS_STAT;
+
+static INS_STAT stats[256];
+static bool skipcheck[256];
+
+static Factory::SoloFactory *cards[CCID_CARD_COUNT];
+static uint8_t cmd[CCID_MAX_APDU_LENGTH];
+static uint8_t expected[CCID_MAX_APDU_LENGTH];
+static uint8_t result[CCID_RESPONSE_BUFFER_SIZE];  // in place as in ./main
+
+static void usage(const char *name) {
+    printf("usage: %s [-x ins] [-v] capture\n", name);
+    printf("  -x ins  do not check responses of INS (hex), e.g. random data. may be repeated\n");
+    printf("  -v      print mismatched responses\n");
+}
+
+static char datadir[] = "/tmp/apdureplay.XXXXXX";
+
+// the data dir has the flash image and the files of the cards only, no subdirs
+static void remove_datadir() {
+    DIR *dir = opendir(datadir);
+    if (dir) {
+        char path[CONFIG_PATH_SIZE * 2];
+        struct dirent *ent;
+        while ((ent = readdir(dir)) != nullptr) {
+            if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+                continue;
+            snprintf(path, sizeof(path), "%s/%s", datadir, ent->d_name);
+            unlink(path);
+        }
+        closedir(dir);
+    }
+    if (rmdir(datadir))
+        printf("can't remove %s\n", datadir);
+}
+
+// flash image of the capture to a temporary data dir and mount it
+static int restore_image(FILE *f, const APDUCAPTURE_HEADER *hdr) {
+    if (mkdtemp(datadir) == nullptr) {
+        printf("can't create data dir\n");
+        return 1;
+    }
+    atexit(remove_datadir);
+    strcpy(solo_config.datadir, datadir);
+    solo_config.fssize = hdr->imagesize;
+
+    uint8_t *image = (uint8_t *)malloc(hdr->imagesize);
+    if (image == nullptr || fread(image, 1, hdr->imagesize, f) != hdr->imagesize) {
+        printf("can't read flash image\n");
+        free(image);
+        return 1;
+    }
+
+    char path[CONFIG_PATH_SIZE * 2];
+    config_data_path(path, sizeof(path), solo_config.fsfile);
+    FILE *img = fopen(path, "wb");
+    size_t res = img ? fwrite(image, 1, hdr->imagesize, img) : 0;
+    if (img)
+        fclose(img);
+    free(image);
+    if (res != hdr->imagesize) {
+        printf("can't write %s\n", path);
+        return 1;
+    }
+
+    printf("flash image %u bytes restored to %s\n", hdr->imagesize, datadir);
+    return hwinit();
+}
+
+static Factory::SoloFactory *get_card(uint8_t card) {
+    if (card >= CCID_CARD_COUNT)
+        return nullptr;
+    if (cards[card] == nullptr) {
+        cards[card] = new Factory::SoloFactory();
+        cards[card]->Init(card);
+    }
+    return cards[card];
+}
+
+int main(int argc, char *argv[]) {
+    bool verbose = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "x:v")) != -1) {
+        switch (opt) {
+        case 'x':
+            skipcheck[strtoul(optarg, nullptr, 16) & 0xff] = true;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind + 1 != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *f = fopen(argv[optind], "rb");
+    APDUCAPTURE_HEADER hdr;
+    if (f == nullptr || apducapture_read_header(f, &hdr)) {
+        printf("%s is not a capture file\n", argv[optind]);
+        return 1;
+    }
+
+    // defaults only, the data dir is the temporary one
+    char *defargv[] = {argv[0], nullptr};
+    if (config_load(1, defargv))
+        return 1;
+    Trace::level = Trace::None;
+    if (restore_image(f, &hdr))
+        return 1;
+
+    Factory::SoloFactory &factory = Factory::SoloFactory::GetSoloFactory();
+    factory.Init();
+    cards[0] = &factory;
+
+    APDUCAPTURE_RECORD rec;
+    uint64_t count = 0, mismatches = 0;
+    int res;
+    while ((res = apducapture_read(f, &rec, cmd, expected, sizeof(cmd))) == 0) {
+        Factory::SoloFactory *solo = get_card(rec.card);
+        if (solo == nullptr || rec.cmdlen < 4)
+            continue;
+        Factory::SoloFactoryScope scope(*solo);
+
+        auto apdu = bstr(cmd, rec.cmdlen);
+        auto resstr = bstr(result, 0, CCID_MAX_APDU_LENGTH);
+        uint64_t start = apducapture_now_us();
+        solo->GetAPDUExecutor().Execute(apdu, resstr, sizeof(result));
+        uint64_t time = apducapture_now_us() - start;
+
+        INS_STAT &st = stats[cmd[1]];
+        if (st.count == 0 || time < st.min)
+            st.min = time;
+        if (time > st.max)
+            st.max = time;
+        st.count++;
+        st.total += time;
+        st.captured += rec.duration;
+
+        if (!skipcheck[cmd[1]] &&
+                (resstr.length() != rec.reslen || memcmp(result, expected, rec.reslen) != 0)) {
+            st.mismatch++;
+            mismatches++;
+            printf("#%lu card %d ins %02x: response mismatch\n", count, rec.card, cmd[1]);
+            if (verbose) {
+                printf("  apdu:     "); dump_hex(apdu, 32);
+                printf("  expected: "); dump_hex(bstr(expected, rec.reslen), 32);
+                printf("  got:      "); dump_hex(resstr, 32);
+            }
+        }
+        count++;
+    }
+    fclose(f);
+    if (res < 0)
+        printf("capture is truncated after %lu records\n", count);
+
+    printf("ins   count     avg us    min us    max us  captured avg  mismatch\n");
+    for (int i = 0; i < 256; i++) {
+        INS_STAT &st = stats[i];
+        if (st.count == 0)
+            continue;
+        printf("%02x %8lu %10lu %9lu %9lu %13lu %9lu\n", i, st.count, st.total / st.count,
+                st.min, st.max, st.captured / st.count, st.mismatch);
+    }
+    printf("%lu apdus, %lu mismatches\n", count, mismatches);
+
+    return mismatches ? 1 : 0;
+}
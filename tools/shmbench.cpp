@@ -0,0 +1,151 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+// Benchmark client for the shared memory APDU transport (SHMAPDU_MODE in src/main.cpp).
+// shmbench [-n count] [-d depth] [-s aid hex] [apdu hex]
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "shmring.h"
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t parse_hex(const char *hex, uint8_t *data, size_t maxlen) {
+    size_t len = 0;
+    while (hex[0] && hex[1] && len < maxlen) {
+        unsigned int b;
+        if (sscanf(hex, "%2x", &b) != 1)
+            break;
+        data[len++] = b;
+        hex += 2;
+    }
+    return len;
+}
+
+// one apdu out of the measurement. returns SW, 0 on timeout
+static uint16_t exchange(SHMAPDU_AREA *area, const uint8_t *apdu, size_t apdulen) {
+    size_t len;
+    uint8_t *res;
+    uint16_t sw = 0;
+    while (shmring_push(&area->req, apdu, apdulen))
+        sched_yield();
+    if (shmring_wait(&area->res, 1000))
+        return 0;
+    if ((res = shmring_front(&area->res, &len)) != nullptr) {
+        if (len >= 2)
+            sw = (res[len - 2] << 8) | res[len - 1];
+        shmring_pop(&area->res, len);
+    }
+    return sw;
+}
+
+int main(int argc, char *argv[]) {
+    long count = 1000000;
+    long depth = 1;
+    const char *aid = nullptr;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:s:")) != -1) {
+        switch (opt) {
+        case 'n':
+            count = atol(optarg);
+            break;
+        case 'd':
+            depth = atol(optarg);
+            break;
+        case 's':
+            aid = optarg;
+            break;
+        default:
+            printf("usage: %s [-n count] [-d depth] [-s aid hex] [apdu hex]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // SELECT OpenPGP applet
+    uint8_t apdu[SHMRING_MAX_FRAME];
+    size_t apdulen = parse_hex((optind < argc) ? argv[optind] : "00A4040006D27600012401", apdu, sizeof(apdu));
+    if (apdulen < 4 || count < 1 || depth < 1) {
+        printf("wrong parameters\n");
+        return 1;
+    }
+
+    int fd = shm_open(SHMAPDU_NAME, O_RDWR, 0);
+    if (fd < 0) {
+        printf("shm_open %s error : %s \n", SHMAPDU_NAME, strerror(errno));
+        return 1;
+    }
+    SHMAPDU_AREA *area = (SHMAPDU_AREA *)mmap(nullptr, sizeof(SHMAPDU_AREA), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (area == MAP_FAILED || area->magic.load(std::memory_order_acquire) != SHMAPDU_MAGIC) {
+        printf("shared memory is not ready\n");
+        return 1;
+    }
+
+    // responses of the previous run
+    size_t len;
+    while (shmring_front(&area->res, &len))
+        shmring_pop(&area->res, len);
+
+    // SELECT of the applet for the measured apdu, e.g. the test applet fafafafa
+    if (aid) {
+        uint8_t select[5 + 16] = {0x00, 0xa4, 0x04, 0x00};
+        select[4] = parse_hex(aid, select + 5, 16);
+        uint16_t selsw = exchange(area, select, 5 + select[4]);
+        if (selsw != 0x9000) {
+            printf("select %s error: %04x\n", aid, selsw);
+            return 1;
+        }
+    }
+
+    long sent = 0, received = 0;
+    uint16_t sw = 0;
+    uint64_t maxlat = 0, sumlat = 0;
+    uint64_t *sendtime = (uint64_t *)calloc(depth, sizeof(uint64_t));
+    uint64_t start = now_ns();
+
+    while (received < count) {
+        while (sent < count && sent - received < depth && shmring_push(&area->req, apdu, apdulen) == 0)
+            sendtime[sent++ % depth] = now_ns();
+
+        if (shmring_wait(&area->res, 1000)) {
+            printf("timeout. sent %ld received %ld\n", sent, received);
+            return 1;
+        }
+
+        uint8_t *res;
+        while ((res = shmring_front(&area->res, &len)) != nullptr) {
+            uint64_t lat = now_ns() - sendtime[received++ % depth];
+            sumlat += lat;
+            if (lat > maxlat)
+                maxlat = lat;
+            if (len >= 2)
+                sw = (res[len - 2] << 8) | res[len - 1];
+            shmring_pop(&area->res, len);
+        }
+    }
+
+    double sec = (now_ns() - start) / 1e9;
+    printf("%ld APDU (%zu bytes, depth %ld) in %.3f s: %.0f APDU/s\n", count, apdulen, depth, sec, count / sec);
+    printf("latency avg %.2f us max %.2f us. last SW %04x\n", sumlat / 1e3 / count, maxlat / 1e3, sw);
+
+    free(sendtime);
+    munmap(area, sizeof(SHMAPDU_AREA));
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+  Copyright 2019 SoloKeys Developers
+
+  Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+  http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+  http://opensource.org/licenses/MIT>, at your option. This file may not be
+  copied, modified, or distributed except according to those terms.
+ */
+
+// Decoder of the binary trace (--trace-file or the SIGUSR2 dump of the card process).
+// tracedump [-l level] file
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include "trace.h"
+
+int main(int argc, char *argv[]) {
+    int maxlevel = Trace::Debug;
+    int opt;
+    while ((opt = getopt(argc, argv, "l:")) != -1) {
+        switch (opt) {
+        case 'l':
+            maxlevel = atoi(optarg);
+            break;
+        default:
+            printf("usage: %s [-l level] file\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind + 1 != argc) {
+        printf("usage: %s [-l level] file\n", argv[0]);
+        return 1;
+    }
+
+    FILE *f = fopen(argv[optind], "rb");
+    if (f == nullptr) {
+        printf("can't open %s\n", argv[optind]);
+        return 1;
+    }
+
+    Trace::Record rec;
+    char line[256];
+    bool first = true;
+    uint32_t nextseq = 0;
+    while (fread(&rec, sizeof(rec), 1, f) == 1) {
+        if (!first && rec.seq != nextseq)
+            printf("trace: %u records lost\n", rec.seq - nextseq);
+        first = false;
+        nextseq = rec.seq + 1;
+
+        if (rec.level > maxlevel)
+            continue;
+        Trace::Format(rec, line, sizeof(line));
+        printf("%s\n", line);
+    }
+
+    fclose(f);
+    return 0;
+}